@@ -1,16 +1,28 @@
 #include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#ifdef _WIN32
 #include <winsock2.h>
 #pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#endif
 
 #define PORT 8080
 
-void startClient() {
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        std::cerr << "Error: WinSock initialization failed!" << std::endl;
-        return;
-    }
+// Frame magic of the binary search protocol; must match BinaryProtocol in Server.cpp.
+const char REQUEST_MAGIC[4] = {'\xC7', 'C', 'W', 'Q'};
+const char RESPONSE_MAGIC[4] = {'\xC7', 'C', 'W', 'R'};
 
+SOCKET connectToServer() {
     SOCKET clientSocket = socket(AF_INET, SOCK_STREAM, 0);
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
@@ -20,9 +32,14 @@ void startClient() {
     if (connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
         std::cerr << "Error: Connection to server failed!" << std::endl;
         closesocket(clientSocket);
-        WSACleanup();
-        return;
+        return INVALID_SOCKET;
     }
+    return clientSocket;
+}
+
+void startClient() {
+    SOCKET clientSocket = connectToServer();
+    if (clientSocket == INVALID_SOCKET) return;
 
     std::cout << "Connected to server!" << std::endl;
 
@@ -49,10 +66,115 @@ void startClient() {
     }
 
     closesocket(clientSocket);
-    WSACleanup();
 }
 
-int main(){
-    startClient();
+// Little-endian integers of the binary protocol.
+void appendU32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>(value >> (8 * i) & 0xFF);
+}
+
+uint32_t readUnsigned(const std::string &data, size_t &pos, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size && pos + i < data.size(); ++i) {
+        value |= uint32_t{static_cast<unsigned char>(data[pos + i])} << (8 * i);
+    }
+    pos += size;
+    return value;
+}
+
+std::string readString(const std::string &data, size_t &pos, size_t lengthSize) {
+    size_t length = readUnsigned(data, pos, lengthSize);
+    std::string text = pos < data.size() ? data.substr(pos, length) : std::string();
+    pos += length;
+    return text;
+}
+
+bool sendAll(SOCKET clientSocket, const std::string &data) {
+    for (size_t sent = 0; sent < data.size();) {
+        int bytes = send(clientSocket, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+        if (bytes <= 0) return false;
+        sent += bytes;
+    }
+    return true;
+}
+
+bool receiveAll(SOCKET clientSocket, std::string &data, size_t size) {
+    data.resize(size);
+    for (size_t received = 0; received < size;) {
+        int bytes = recv(clientSocket, &data[received], static_cast<int>(size - received), 0);
+        if (bytes <= 0) return false;
+        received += bytes;
+    }
+    return true;
+}
+
+// Answers every line of standard input as one query over a single connection, using the binary protocol.
+void startBinaryClient(uint32_t limit) {
+    SOCKET clientSocket = connectToServer();
+    if (clientSocket == INVALID_SOCKET) return;
+
+    std::string input;
+    while (std::getline(std::cin, input)) {
+        std::string request(REQUEST_MAGIC, sizeof(REQUEST_MAGIC));
+        appendU32(request, static_cast<uint32_t>(8 + input.size()));
+        appendU32(request, 0); // Offset.
+        appendU32(request, limit);
+        request += input;
+
+        std::string header, payload;
+        if (!sendAll(clientSocket, request) || !receiveAll(clientSocket, header, 8) ||
+            header.compare(0, 4, RESPONSE_MAGIC, 4) != 0) {
+            std::cerr << "Error: Invalid response from server!" << std::endl;
+            break;
+        }
+        size_t pos = 4;
+        if (!receiveAll(clientSocket, payload, readUnsigned(header, pos, 4))) {
+            std::cerr << "Error: Invalid response from server!" << std::endl;
+            break;
+        }
+
+        pos = 0;
+        uint32_t total = readUnsigned(payload, pos, 4);
+        uint32_t count = readUnsigned(payload, pos, 4);
+        std::cout << "Query: " << input << "\n";
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t id = readUnsigned(payload, pos, 4);
+            uint32_t year = readUnsigned(payload, pos, 2);
+            uint32_t ratingBits = readUnsigned(payload, pos, 4);
+            float rating;
+            std::memcpy(&rating, &ratingBits, sizeof(rating));
+            std::string language = readString(payload, pos, 1);
+            std::string genres;
+            for (uint32_t genreCount = readUnsigned(payload, pos, 1); genreCount > 0; --genreCount) {
+                genres += readString(payload, pos, 1) + " ";
+            }
+            std::string title = readString(payload, pos, 2);
+            std::string overview = readString(payload, pos, 4);
+            std::cout << "ID: " << id << "\nTitle: " << title << "\nYear: " << year << "\nRating: " << rating
+                      << "\nLanguage: " << language << "\nGenres: " << genres << "\nOverview: " << overview << "\n\n";
+        }
+        std::cout << "Showing " << count << " of " << total << " movies\n\n";
+    }
+
+    closesocket(clientSocket);
+}
+
+int main(int argc, char **argv){
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::cerr << "Error: WinSock initialization failed!" << std::endl;
+        return 1;
+    }
+#endif
+    // "Client --binary [limit]" runs one query per input line on a single connection.
+    if (argc > 1 && std::string(argv[1]) == "--binary") {
+        startBinaryClient(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 50);
+    } else {
+        startClient();
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
     return 0;
 }
@@ -0,0 +1,157 @@
+// LoadBenchmark.cpp
+//
+// Measures how movie loading scales with thread count and dataset size.
+// The CSV is replicated in memory (header once, rows repeated), and every
+// configuration is ingested several times into a fresh snapshot. The pre-scan,
+// parse, index and merge phases are reported separately as CSV or JSON.
+//
+// Usage: LoadBenchmark [csv] [--threads 1,2,4,8] [--scales 1,10,100] [--runs 5] [--format csv|json]
+#define COURSEWORK_NO_SERVER_MAIN
+#include "Server.cpp"
+
+#include <cmath>
+
+/**
+ * @brief Parse a comma-separated list of positive integers.
+ * @param text The list, e.g. "1,2,4".
+ * @return The parsed values; invalid entries are skipped.
+ */
+std::vector<size_t> parseList(const std::string &text) {
+    std::vector<size_t> values;
+    std::istringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t value = 0;
+        if (std::from_chars(item.data(), item.data() + item.size(), value).ec == std::errc() && value > 0) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+/**
+ * @brief Build a dataset that contains the rows of the CSV file `scale` times.
+ * @param csv The original file contents.
+ * @param scale The number of copies of the data rows.
+ * @return The header followed by the repeated rows.
+ */
+std::string replicate(std::string_view csv, size_t scale) {
+    size_t headerEnd = csv.find('\n');
+    if (headerEnd == std::string_view::npos) return std::string(csv);
+    std::string_view header = csv.substr(0, headerEnd + 1);
+    std::string_view rows = csv.substr(headerEnd + 1);
+
+    std::string data;
+    data.reserve(header.size() + (rows.size() + 1) * scale);
+    data += header;
+    for (size_t i = 0; i < scale; ++i) {
+        data += rows;
+        if (!rows.empty() && rows.back() != '\n') data += '\n';
+    }
+    return data;
+}
+
+/**
+ * @brief Summary statistics of repeated measurements, in seconds.
+ */
+struct Summary {
+    double min, median, p99;
+};
+
+/**
+ * @brief Compute min, median and 99th percentile (nearest rank) of samples.
+ */
+Summary summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    size_t rank = static_cast<size_t>(std::ceil(0.99 * n));
+    return {samples.front(), n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2,
+            samples[std::max<size_t>(rank, 1) - 1]};
+}
+
+int main(int argc, char **argv) {
+    std::string path = "9000plus.csv";
+    std::vector<size_t> threadCounts = {1, 2, 4, 8, 16, 32};
+    std::vector<size_t> scales = {1, 10, 100};
+    size_t runs = 5;
+    std::string format = "csv";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue) {
+            threadCounts = parseList(argv[++i]);
+        } else if (arg == "--scales" && hasValue) {
+            scales = parseList(argv[++i]);
+        } else if (arg == "--runs" && hasValue) {
+            runs = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--format" && hasValue) {
+            format = argv[++i];
+        } else if (arg.rfind("--", 0) != 0) {
+            path = arg;
+        } else {
+            std::cerr << "Usage: LoadBenchmark [csv] [--threads 1,2,4] [--scales 1,10,100] [--runs 5]"
+                         " [--format csv|json]" << std::endl;
+            return 1;
+        }
+    }
+
+    MappedFile file(path);
+    if (!file.isOpen() || threadCounts.empty() || scales.empty()) {
+        std::cerr << "Error: Unable to open file!" << std::endl;
+        return 1;
+    }
+
+    const char *phaseNames[] = {"scan", "parse", "index", "merge", "total"};
+    bool json = format == "json";
+    if (json) {
+        std::cout << "[\n";
+    } else {
+        std::cout << "scale,threads,movies,phase,runs,min_seconds,median_seconds,p99_seconds\n";
+    }
+
+    bool firstRow = true;
+    for (size_t scale : scales) {
+        std::string data = replicate(std::string_view(file.data(), file.size()), scale);
+        for (size_t threads : threadCounts) {
+            ThreadPool pool(threads - 1); // The calling thread is the last of `threads`.
+            std::vector<double> samples[5];
+            size_t movieCount = 0;
+            for (size_t run = 0; run < runs; ++run) {
+                MovieSnapshot snapshot;
+                LoadStats stats;
+                auto start = std::chrono::steady_clock::now();
+                ingestMovies(data.data(), 0, data.size(), threads, snapshot, &stats, pool);
+                std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+
+                samples[0].push_back(stats.scanSeconds);
+                samples[1].push_back(stats.parseSeconds);
+                samples[2].push_back(stats.indexSeconds);
+                samples[3].push_back(stats.mergeSeconds);
+                samples[4].push_back(total.count());
+                movieCount = stats.movies;
+            }
+
+            for (int phase = 0; phase < 5; ++phase) {
+                Summary summary = summarize(samples[phase]);
+                if (json) {
+                    std::cout << (firstRow ? "" : ",\n") << "  {\"scale\": " << scale << ", \"threads\": " << threads
+                              << ", \"movies\": " << movieCount << ", \"phase\": \"" << phaseNames[phase]
+                              << "\", \"runs\": " << runs << ", \"min_seconds\": " << summary.min
+                              << ", \"median_seconds\": " << summary.median << ", \"p99_seconds\": " << summary.p99
+                              << "}";
+                } else {
+                    std::cout << scale << "," << threads << "," << movieCount << "," << phaseNames[phase] << ","
+                              << runs << "," << summary.min << "," << summary.median << "," << summary.p99 << "\n";
+                }
+                firstRow = false;
+            }
+            std::cout.flush();
+        }
+    }
+
+    if (json) {
+        std::cout << "\n]\n";
+    }
+    return 0;
+}
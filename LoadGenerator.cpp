@@ -0,0 +1,419 @@
+// LoadGenerator.cpp
+//
+// Replays a query log against a running server from many concurrent
+// connections and reports throughput and latency percentiles as CSV.
+// Requests are issued open-loop at a fixed rate, and each latency is
+// measured from the time the request was scheduled, so a stalled server
+// shows up in the percentiles instead of slowing the generator down. With
+// --rate 0 every connection keeps its pipeline full instead (closed loop).
+//
+// Every line of the log is one query:
+//   POST genre=Action&year=&language=en&keywords=batman   (web form search)
+//   SEARCH the dark knight                                (keyword search)
+//   GET /                                                 (any GET target)
+// A line without a command is taken as POST form fields. SEARCH queries use
+// the binary protocol so they can share kept-alive connections.
+//
+// Usage: LoadGenerator [log] [--host 127.0.0.1] [--port 8080] [--connections 16]
+//                      [--rate 500] [--duration 10] [--pipeline 1] [--close]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+#define poll WSAPoll
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief One query of the log, encoded once as the bytes sent for it.
+ */
+struct Query {
+    std::string request; ///< The complete request.
+    bool binary;         ///< Whether the response is a binary protocol frame.
+};
+
+/**
+ * @brief A request that has been sent and waits for its response.
+ */
+struct InFlight {
+    Clock::time_point scheduled; ///< When the request was due; latency is measured from here.
+    bool binary;
+};
+
+/**
+ * @brief A client connection and the requests pipelined on it.
+ */
+struct Connection {
+    SOCKET socket = INVALID_SOCKET;
+    bool connecting = false;       ///< Whether the non-blocking connect is still in progress.
+    std::string output;            ///< Request bytes not sent yet.
+    size_t sent = 0;               ///< Bytes of `output` already sent.
+    std::string input;             ///< Received bytes not parsed yet.
+    std::deque<InFlight> inFlight; ///< Requests in the order their responses arrive.
+};
+
+/**
+ * @brief Encodes one line of the query log.
+ * @return False if the line is empty or a comment.
+ */
+bool parseQuery(std::string_view line, const std::string &host, bool close, Query &query) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+    if (line.empty() || line.front() == '#') return false;
+
+    std::string connection = close ? "Connection: close\r\n" : "";
+    if (line.starts_with("SEARCH ")) {
+        // A binary frame: magic, payload length, offset, limit and the keywords.
+        std::string_view keywords = line.substr(7);
+        uint32_t fields[3] = {static_cast<uint32_t>(8 + keywords.size()), 0, 50};
+        query.request.assign("\xC7" "CWQ");
+        for (uint32_t value : fields) {
+            for (int i = 0; i < 4; ++i) query.request += static_cast<char>(value >> (8 * i) & 0xFF);
+        }
+        query.request += keywords;
+        query.binary = true;
+        return true;
+    }
+    if (line.starts_with("GET ")) {
+        query.request = "GET " + std::string(line.substr(4)) + " HTTP/1.1\r\nHost: " + host + "\r\n" + connection + "\r\n";
+        query.binary = false;
+        return true;
+    }
+    std::string_view body = line.starts_with("POST ") ? line.substr(5) : line;
+    query.request = "POST / HTTP/1.1\r\nHost: " + host + "\r\nContent-Type: application/x-www-form-urlencoded\r\n" +
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n" + connection + "\r\n" + std::string(body);
+    query.binary = false;
+    return true;
+}
+
+/**
+ * @brief The queries replayed when no log file is given.
+ */
+const char *DEFAULT_LOG[] = {
+        "POST genre=Action&year=&language=en&keywords=batman",
+        "POST genre=Drama&year=&language=fr&keywords=",
+        "POST genre=&year=2019&language=ja&keywords=",
+        "POST genre=&year=&language=&keywords=love+war",
+        "POST genre=Animation&year=&language=&keywords=the&sort=rating_desc",
+        "SEARCH spider man",
+        "SEARCH the dark knight",
+        "SEARCH love",
+        "GET /",
+};
+
+/**
+ * @brief Finds the end of the first complete response in a buffer.
+ *
+ * @param buffer Received bytes, starting at a response.
+ * @param binary Whether the response is a binary protocol frame.
+ * @param status Receives the HTTP status code; 200 for binary frames.
+ * @param closes Receives whether the server closes the connection after this response.
+ * @return The length of the response, 0 if it is incomplete, or npos if it is malformed.
+ */
+size_t responseLength(std::string_view buffer, bool binary, int &status, bool &closes) {
+    if (binary) {
+        if (buffer.size() < 8) return 0;
+        if (buffer.substr(0, 4) != "\xC7" "CWR") return std::string_view::npos;
+        size_t payload = 0;
+        for (int i = 0; i < 4; ++i) payload |= size_t{static_cast<unsigned char>(buffer[4 + i])} << (8 * i);
+        status = 200;
+        closes = false;
+        return buffer.size() < 8 + payload ? 0 : 8 + payload;
+    }
+
+    size_t headerEnd = buffer.find("\r\n\r\n");
+    if (headerEnd == std::string_view::npos) return 0;
+    std::string_view head = buffer.substr(0, headerEnd + 2);
+    if (!head.starts_with("HTTP/1.") || head.size() < 12 ||
+        std::from_chars(head.data() + 9, head.data() + 12, status).ec != std::errc()) {
+        return std::string_view::npos;
+    }
+    closes = head.find("\r\nConnection: close\r\n") != std::string_view::npos;
+
+    size_t pos = headerEnd + 4;
+    if (head.find("\r\nTransfer-Encoding: chunked\r\n") != std::string_view::npos) {
+        while (true) {
+            size_t lineEnd = buffer.find("\r\n", pos);
+            if (lineEnd == std::string_view::npos) return 0;
+            size_t chunk = 0;
+            if (std::from_chars(buffer.data() + pos, buffer.data() + lineEnd, chunk, 16).ec != std::errc()) {
+                return std::string_view::npos;
+            }
+            pos = lineEnd + 2 + chunk + 2;
+            if (pos > buffer.size()) return 0;
+            if (chunk == 0) return pos;
+        }
+    }
+    size_t length = 0;
+    size_t field = head.find("\r\nContent-Length: ");
+    if (field != std::string_view::npos) {
+        std::from_chars(head.data() + field + 18, head.data() + head.size(), length);
+    }
+    return buffer.size() < pos + length ? 0 : pos + length;
+}
+
+/**
+ * @brief Starts a non-blocking connect.
+ * @return False if the socket could not be created or the connect failed at once.
+ */
+bool openConnection(Connection &connection, const sockaddr_in &address) {
+    connection.socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (connection.socket == INVALID_SOCKET) return false;
+    int noDelay = 1;
+    setsockopt(connection.socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    ioctlsocket(connection.socket, FIONBIO, &nonBlocking);
+    bool pending = connect(connection.socket, (const sockaddr *) &address, sizeof(address)) != 0 &&
+                   WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    fcntl(connection.socket, F_SETFL, fcntl(connection.socket, F_GETFL, 0) | O_NONBLOCK);
+    bool pending = connect(connection.socket, (const sockaddr *) &address, sizeof(address)) != 0 &&
+                   errno == EINPROGRESS;
+#endif
+    connection.connecting = pending;
+    connection.output.clear();
+    connection.sent = 0;
+    connection.input.clear();
+    return true;
+}
+
+/**
+ * @brief Closes a connection; its unanswered requests are returned as failed.
+ * @return The number of requests that were still waiting for a response.
+ */
+size_t closeConnection(Connection &connection) {
+    if (connection.socket != INVALID_SOCKET) closesocket(connection.socket);
+    connection.socket = INVALID_SOCKET;
+    size_t lost = connection.inFlight.size();
+    connection.inFlight.clear();
+    return lost;
+}
+
+/**
+ * @brief Value at a percentile of sorted samples (nearest rank).
+ */
+double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+int main(int argc, char **argv) {
+    std::string logPath, host = "127.0.0.1";
+    int port = 8080;
+    size_t connectionCount = 16, pipeline = 1;
+    double rate = 500, duration = 10;
+    bool close = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) {
+            host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            port = std::atoi(argv[++i]);
+        } else if (arg == "--connections" && hasValue) {
+            connectionCount = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rate" && hasValue) {
+            rate = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--duration" && hasValue) {
+            duration = std::max(0.1, std::atof(argv[++i]));
+        } else if (arg == "--pipeline" && hasValue) {
+            pipeline = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--close") {
+            close = true;
+        } else if (arg.rfind("--", 0) != 0) {
+            logPath = arg;
+        } else {
+            std::cerr << "Usage: LoadGenerator [log] [--host 127.0.0.1] [--port 8080] [--connections 16]"
+                         " [--rate 500] [--duration 10] [--pipeline 1] [--close]" << std::endl;
+            return 1;
+        }
+    }
+    if (close) pipeline = 1; // A closing response ends the connection, so nothing may follow it.
+
+    std::vector<Query> queries;
+    Query query;
+    if (logPath.empty()) {
+        for (const char *line : DEFAULT_LOG) {
+            if (parseQuery(line, host, close, query)) queries.push_back(query);
+        }
+    } else {
+        std::ifstream log(logPath);
+        std::string line;
+        while (std::getline(log, line)) {
+            if (parseQuery(line, host, close, query)) queries.push_back(query);
+        }
+    }
+    if (queries.empty()) {
+        std::cerr << "Error: No queries to replay!" << std::endl;
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = inet_addr(host.c_str());
+
+    std::vector<Connection> connections(connectionCount);
+    std::vector<pollfd> pollSet;
+    std::deque<Clock::time_point> backlog; // Requests that are due but found no free connection yet.
+    std::vector<double> latencies;         // Milliseconds, of every completed request.
+    size_t nextQuery = 0, sent = 0, errors = 0;
+
+    auto interval = rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))
+                             : Clock::duration::zero();
+    Clock::time_point start = Clock::now();
+    Clock::time_point stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+    Clock::time_point drainDeadline = stop + std::chrono::seconds(5);
+    Clock::time_point nextDue = start;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        bool running = now < stop;
+        size_t waiting = 0;
+        for (const Connection &connection : connections) waiting += connection.inFlight.size();
+        if ((!running && waiting == 0) || now >= drainDeadline) break;
+
+        // Open loop: requests fall due at the configured rate whether or not earlier ones were answered.
+        while (rate > 0 && running && nextDue <= now) {
+            backlog.push_back(nextDue);
+            nextDue += interval;
+        }
+
+        // Hand due requests to connections with a free pipeline slot; reopen closed connections.
+        for (Connection &connection : connections) {
+            if (!running) break;
+            if (connection.socket == INVALID_SOCKET && !openConnection(connection, address)) {
+                ++errors;
+                continue;
+            }
+            while (connection.inFlight.size() < pipeline && (rate == 0 || !backlog.empty())) {
+                Clock::time_point scheduled = rate == 0 ? now : backlog.front();
+                if (rate > 0) backlog.pop_front();
+                const Query &next = queries[nextQuery++ % queries.size()];
+                connection.output += next.request;
+                connection.inFlight.push_back({scheduled, next.binary});
+                ++sent;
+            }
+        }
+
+        pollSet.clear();
+        for (const Connection &connection : connections) {
+            short events = POLLIN;
+            if (connection.connecting || connection.sent < connection.output.size()) events |= POLLOUT;
+            pollSet.push_back({connection.socket, connection.socket == INVALID_SOCKET ? short(0) : events, 0});
+        }
+        Clock::time_point wakeup = rate > 0 && running ? std::min(nextDue, stop) : std::min(now + std::chrono::milliseconds(100),
+                                                                                             running ? stop : drainDeadline);
+        int timeout = static_cast<int>(std::max<int64_t>(
+                0, std::chrono::duration_cast<std::chrono::milliseconds>(wakeup - now).count()));
+        if (poll(pollSet.data(), static_cast<unsigned long>(pollSet.size()), timeout) < 0) break;
+
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection &connection = connections[i];
+            short revents = pollSet[i].revents;
+            if (connection.socket == INVALID_SOCKET || revents == 0) continue;
+            if (revents & (POLLERR | POLLNVAL)) {
+                errors += closeConnection(connection);
+                continue;
+            }
+            if (revents & POLLOUT) {
+                connection.connecting = false;
+                while (connection.sent < connection.output.size()) {
+                    int bytes = send(connection.socket, connection.output.data() + connection.sent,
+                                     static_cast<int>(connection.output.size() - connection.sent), 0);
+                    if (bytes <= 0) break; // Would block, or the error surfaces on the next poll.
+                    connection.sent += bytes;
+                }
+                if (connection.sent == connection.output.size()) {
+                    connection.output.clear();
+                    connection.sent = 0;
+                }
+            }
+            if (revents & (POLLIN | POLLHUP)) {
+                char buffer[65536];
+                int bytes = recv(connection.socket, buffer, sizeof(buffer), 0);
+                if (bytes <= 0) {
+                    errors += closeConnection(connection);
+                    continue;
+                }
+                connection.input.append(buffer, bytes);
+
+                // Complete the requests whose responses have fully arrived.
+                Clock::time_point received = Clock::now();
+                size_t consumed = 0;
+                while (!connection.inFlight.empty()) {
+                    int status = 0;
+                    bool closes = false;
+                    std::string_view pending = std::string_view(connection.input).substr(consumed);
+                    size_t length = responseLength(pending, connection.inFlight.front().binary, status, closes);
+                    if (length == std::string_view::npos) {
+                        errors += closeConnection(connection);
+                        break;
+                    }
+                    if (length == 0) break;
+                    consumed += length;
+                    if (status >= 200 && status < 400) {
+                        std::chrono::duration<double, std::milli> latency = received - connection.inFlight.front().scheduled;
+                        latencies.push_back(latency.count());
+                    } else {
+                        ++errors;
+                    }
+                    connection.inFlight.pop_front();
+                    if (closes) {
+                        errors += closeConnection(connection);
+                        break;
+                    }
+                }
+                connection.input.erase(0, consumed);
+            }
+        }
+    }
+
+    size_t unanswered = backlog.size();
+    for (Connection &connection : connections) unanswered += closeConnection(connection);
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "connections,pipeline,target_rate,seconds,sent,completed,errors,unanswered,throughput_rps,"
+                 "p50_ms,p90_ms,p99_ms,p999_ms,max_ms\n"
+              << connectionCount << "," << pipeline << "," << rate << "," << elapsed.count() << "," << sent << ","
+              << latencies.size() << "," << errors << "," << unanswered << ","
+              << static_cast<double>(latencies.size()) / std::min(elapsed.count(), duration) << ","
+              << percentile(latencies, 0.5) << "," << percentile(latencies, 0.9) << "," << percentile(latencies, 0.99)
+              << "," << percentile(latencies, 0.999) << "," << (latencies.empty() ? 0 : latencies.back()) << "\n";
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
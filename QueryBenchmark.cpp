@@ -0,0 +1,252 @@
+// QueryBenchmark.cpp
+//
+// Replays a fixed query mix against the InvertedIndex search APIs and the
+// web form search path, without any networking. The dataset is loaded once;
+// every query class is then run from 1..N threads and reported as CSV with
+// nanoseconds, heap allocations and result counts per query. Form searches
+// bypass the result cache unless --cache is given.
+//
+// Usage: QueryBenchmark [csv] [--threads 1,4] [--iterations 200] [--cache]
+#define COURSEWORK_NO_SERVER_MAIN
+#include "Server.cpp"
+
+#include <random>
+#include <new>
+#include <cstdlib>
+
+/// Heap allocations made by the current thread; counted by the operator new replacement below.
+static thread_local uint64_t threadAllocations = 0;
+
+// The replacements are kept out of line: inlined into the Server.cpp code, the compiler would
+// pair `new` expressions with `free` and warn about mismatched allocation functions.
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+NOINLINE void *operator new(size_t size) {
+    ++threadAllocations;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+NOINLINE void *operator new(size_t size, std::align_val_t alignment) {
+    ++threadAllocations;
+    size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    if (void *p = _aligned_malloc(size ? size : 1, align)) return p;
+#else
+    // aligned_alloc needs a size that is a multiple of the alignment.
+    if (void *p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) return p;
+#endif
+    throw std::bad_alloc();
+}
+
+NOINLINE void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+NOINLINE void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+NOINLINE void operator delete(void *p, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+NOINLINE void operator delete(void *p, size_t, std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+
+/**
+ * @brief One query of the replayed mix.
+ */
+struct Query {
+    enum Kind { Keywords, Category, Form } kind;
+    std::vector<std::string> keys;                        ///< Keywords, or {category, value}.
+    std::unordered_map<std::string, std::string> params;  ///< Form fields for `Form` queries.
+};
+
+/**
+ * @brief A named group of queries measured together.
+ */
+struct QueryClass {
+    std::string name;
+    std::vector<Query> queries;
+};
+
+/// Whether form searches go through the shared result cache.
+static bool useCache = false;
+
+/**
+ * @brief Run a single query.
+ * @return The number of matching movies.
+ */
+size_t runQuery(const MovieSnapshot &snapshot, Query &query) {
+    switch (query.kind) {
+        case Query::Keywords:
+            return snapshot.index.searchByKeywords(query.keys).size();
+        case Query::Category:
+            return snapshot.index.searchByCategory(query.keys[0], query.keys[1]).size();
+        case Query::Form:
+            return searchMovies(snapshot, query.params, useCache ? &queryCache : nullptr).total;
+    }
+    return 0;
+}
+
+/**
+ * @brief Build a form query with all fields present.
+ */
+Query formQuery(const std::string &genre, const std::string &year, const std::string &language,
+                const std::string &keywords, const std::string &sort = "") {
+    Query query{Query::Form, {}, {}};
+    std::string encodedGenre = genre;
+    std::replace(encodedGenre.begin(), encodedGenre.end(), ' ', '+');
+    query.params = {{"genre", encodedGenre}, {"year", year}, {"language", language}, {"keywords", keywords},
+                    {"sort", sort}};
+    return query;
+}
+
+/**
+ * @brief Build the query mix from the terms and facets of the loaded data.
+ */
+std::vector<QueryClass> buildQueryMix(const MovieSnapshot &snapshot) {
+    // Overview terms by document frequency.
+    std::vector<std::pair<size_t, std::string>> terms;
+    snapshot.index.forEachList([&](int category, const std::string &word, const PostingList &list) {
+        if (category == InvertedIndex::Overview) {
+            terms.emplace_back(list.size(), word);
+        }
+    });
+    std::sort(terms.begin(), terms.end(), std::greater<>());
+
+    std::vector<std::string> common, medium, rare;
+    for (const auto &term : terms) {
+        if (common.size() < 50) {
+            common.push_back(term.second);
+        } else if (term.first >= 20 && term.first <= 500) {
+            medium.push_back(term.second);
+        } else if (term.first >= 2 && term.first <= 10) {
+            rare.push_back(term.second);
+        }
+    }
+    std::vector<std::string> genres(snapshot.genres.begin(), snapshot.genres.end());
+    std::vector<std::string> languages(snapshot.languages.begin(), snapshot.languages.end());
+    std::vector<int> years(snapshot.years.begin(), snapshot.years.end());
+    std::sort(genres.begin(), genres.end());
+    std::sort(languages.begin(), languages.end());
+
+    std::mt19937 rng(42);
+    auto pick = [&](const auto &values) -> const auto & { return values[rng() % values.size()]; };
+    const size_t perClass = 200;
+
+    std::vector<QueryClass> mix = {{"keyword_common", {}}, {"keyword_rare", {}}, {"keywords_2_to_5", {}},
+                                   {"category_genre", {}}, {"form_facets", {}}, {"form_facets_keyword", {}},
+                                   {"form_common_keywords", {}}, {"form_rare_keyword", {}}, {"form_sorted", {}}};
+    if (common.empty() || medium.empty() || rare.empty() || genres.empty() || languages.empty() || years.empty()) {
+        return {};
+    }
+    for (size_t i = 0; i < perClass; ++i) {
+        mix[0].queries.push_back({Query::Keywords, {pick(common)}, {}});
+        mix[1].queries.push_back({Query::Keywords, {pick(rare)}, {}});
+
+        Query multi{Query::Keywords, {}, {}};
+        size_t count = 2 + rng() % 4;
+        for (size_t k = 0; k < count; ++k) {
+            multi.keys.push_back(k % 2 ? pick(medium) : pick(common));
+        }
+        mix[2].queries.push_back(multi);
+
+        mix[3].queries.push_back({Query::Category, {"genre", pick(genres)}, {}});
+        mix[4].queries.push_back(formQuery(pick(genres), std::to_string(pick(years)), pick(languages), ""));
+        mix[5].queries.push_back(formQuery(pick(genres), "", "en", pick(medium)));
+        mix[6].queries.push_back(formQuery("", "", "", pick(common) + "+" + pick(common)));
+        mix[7].queries.push_back(formQuery("", "", "", pick(rare)));
+        mix[8].queries.push_back(formQuery(pick(genres), "", "", "", rng() % 2 ? "rating_asc" : "rating_desc"));
+    }
+    return mix;
+}
+
+int main(int argc, char **argv) {
+    std::string path = "9000plus.csv";
+    std::vector<size_t> threadCounts = {1, std::max(1u, std::thread::hardware_concurrency())};
+    size_t iterations = 200;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue) {
+            threadCounts.clear();
+            std::istringstream stream(argv[++i]);
+            std::string item;
+            while (std::getline(stream, item, ',')) {
+                if (size_t count = std::strtoul(item.c_str(), nullptr, 10)) threadCounts.push_back(count);
+            }
+        } else if (arg == "--iterations" && hasValue) {
+            iterations = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg.rfind("--", 0) != 0) {
+            path = arg;
+        } else {
+            std::cerr << "Usage: QueryBenchmark [csv] [--threads 1,4] [--iterations 200] [--cache]" << std::endl;
+            return 1;
+        }
+    }
+
+    loadMovies(path, std::max(1u, std::thread::hardware_concurrency()));
+    std::shared_ptr<const MovieSnapshot> snapshot = acquireSnapshot();
+    std::vector<QueryClass> mix = buildQueryMix(*snapshot);
+    if (mix.empty()) {
+        std::cerr << "Error: Not enough data to build the query mix!" << std::endl;
+        return 1;
+    }
+
+    std::cout << "class,threads,queries,ns_per_query,allocs_per_query,avg_results\n";
+    for (QueryClass &queryClass : mix) {
+        for (size_t threads : threadCounts) {
+            std::vector<double> elapsed(threads);
+            std::vector<uint64_t> allocations(threads), results(threads);
+
+            auto worker = [&](size_t index) {
+                // Every thread replays its own copy of the queries; one untimed pass warms the caches.
+                std::vector<Query> queries = queryClass.queries;
+                for (Query &query : queries) runQuery(*snapshot, query);
+
+                uint64_t allocationsBefore = threadAllocations;
+                uint64_t matched = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (size_t pass = 0; pass < iterations; ++pass) {
+                    for (Query &query : queries) matched += runQuery(*snapshot, query);
+                }
+                std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+                elapsed[index] = time.count();
+                allocations[index] = threadAllocations - allocationsBefore;
+                results[index] = matched;
+            };
+
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < threads; ++t) pool.emplace_back(worker, t);
+            for (auto &thread : pool) thread.join();
+
+            double queries = static_cast<double>(iterations * queryClass.queries.size());
+            double totalSeconds = 0, totalAllocations = 0, totalResults = 0;
+            for (size_t t = 0; t < threads; ++t) {
+                totalSeconds += elapsed[t];
+                totalAllocations += static_cast<double>(allocations[t]);
+                totalResults += static_cast<double>(results[t]);
+            }
+            double runQueries = queries * static_cast<double>(threads);
+            std::cout << queryClass.name << "," << threads << "," << static_cast<uint64_t>(runQueries) << ","
+                      << totalSeconds * 1e9 / runQueries << "," << totalAllocations / runQueries << ","
+                      << totalResults / runQueries << "\n";
+            std::cout.flush();
+        }
+    }
+    return 0;
+}
@@ -5,7 +5,23 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <string_view>
+#define NOMINMAX
+#ifdef _WIN32
 #include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#endif
 #include <thread>
 #include <mutex>
 #include <set>
@@ -13,16 +29,20 @@
 #include <queue>
 #include <condition_variable>
 
-
-#pragma comment(lib, "ws2_32.lib")
 #define PORT 8080
 #define BUFFER_SIZE 4096
+#define IDLE_TIMEOUT_SECONDS 15 // Connections idle between requests, or not reading a response, this long are closed.
+#define RESULTS_PER_PAGE 50 // Movies per results page unless the request asks for another limit.
+#define MAX_RESULTS_PER_PAGE 500 // Largest page a request can ask for, so every response stays bounded.
+#define STREAM_CHUNK_SIZE 16384 // Bytes of a streamed response body rendered and sent at a time.
+#define MAX_QUEUED_REQUESTS 1024 // Requests waiting for a worker beyond this are answered with 503.
+#define QUEUE_DEADLINE_MS 500 // Requests that waited longer than this for a worker are answered with 503.
+#define MAX_CONNECTIONS_PER_CLIENT 64 // Further connections from the same address are refused with 503.
 
 /**
-* @brief Represents a movie with various attributes.
+* @brief Represents a movie with various attributes, as read from the data file.
 *
 * The `Movie` struct encapsulates information about a single movie, including:
-* - ID: A unique identifier for the movie.
 * - Title: The name of the movie.
 * - Overview: A brief description of the movie's plot or storyline.
 * - Language: The primary language in which the movie is available.
@@ -30,894 +50,5639 @@
 * - Year: The release year of the movie.
 * - Rating: The movie's average rating on a scale of 0 to 10.
 * - Poster URL: A link to the movie's poster image.
+*
+* The strings are views into the parsed file or a scratch buffer; a record is only valid
+* until it is added to a `MovieStore`, which keeps the data.
 */
 struct Movie {
-    int id;
-    std::string title, overview, language;
-    std::vector<std::string> genres;
+    std::string_view title, overview, language;
+    std::vector<std::string_view> genres;
     int year;
     float rating;
-    std::string posterUrl;
+    std::string_view posterUrl;
 };
 
+/**
+ * @brief Appends values to a binary snapshot in the native byte order.
+ *
+ * Trivially copyable values are copied as they are; strings and vectors are written as
+ * a 64-bit element count followed by their elements.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+class SnapshotWriter {
+public:
+    std::string bytes; ///< The encoded snapshot so far.
+
+    template <typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain values are copied as bytes");
+        bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    void write(const std::string &text) {
+        write(uint64_t{text.size()});
+        bytes.append(text);
+    }
+
+    template <typename T>
+    void write(const std::vector<T> &values) {
+        write(uint64_t{values.size()});
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            bytes.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+        } else {
+            for (const T &value : values) write(value);
+        }
+    }
+};
 
 /**
- * @brief A thread-safe inverted index for efficient movie search.
+ * @brief Reads values written by `SnapshotWriter` from a byte range, e.g. a mapped file.
  *
- * This class maps keywords and attributes (e.g., genres, language, title) to
- * sets of movie IDs, allowing fast and flexible search operations.
+ * Every read checks the remaining length first, so a truncated or corrupt snapshot makes
+ * a read fail instead of reading past the end.
  */
-#include <string>
-#include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <mutex>
-#include <algorithm>
-#include <sstream>
+class SnapshotReader {
+    const char *cursor;
+    const char *end;
 
-class InvertedIndex {
-private:
-    std::vector<std::unordered_map<std::string, std::unordered_set<int>>> shards;
-    std::vector<std::mutex> shardMutexes;
-    size_t shardCount;
+public:
+    SnapshotReader(const char *data, size_t size) : cursor(data), end(data + size) {}
 
     /**
-     * @brief Get the shard index for a given key.
-     * @param key The key to hash for determining the shard.
-     * @return The index of the shard.
+     * @brief Get the number of bytes not read yet.
      */
-    size_t getShardIndex(const std::string& key) const {
-        std::hash<std::string> hasher;
-        return hasher(key) % shardCount;
+    size_t remaining() const {
+        return static_cast<size_t>(end - cursor);
     }
 
-public:
+    template <typename T>
+    bool read(T &value) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain values are copied as bytes");
+        if (remaining() < sizeof(T)) return false;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    bool read(std::string &text) {
+        uint64_t size;
+        if (!read(size) || size > remaining()) return false;
+        text.assign(cursor, static_cast<size_t>(size));
+        cursor += size;
+        return true;
+    }
+
+    template <typename T>
+    bool read(std::vector<T> &values) {
+        uint64_t size;
+        if (!read(size) || size > remaining()) return false; // Every element takes at least a byte.
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (size > remaining() / sizeof(T)) return false;
+            values.resize(static_cast<size_t>(size));
+            if (!values.empty()) std::memcpy(values.data(), cursor, values.size() * sizeof(T));
+            cursor += values.size() * sizeof(T);
+        } else {
+            values.resize(static_cast<size_t>(size));
+            for (T &value : values) {
+                if (!read(value)) return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Column-oriented storage of all movies, addressed by movie ID.
+ *
+ * Titles, overviews and poster URLs are kept back to back in one character arena and
+ * addressed by offset and length. Genres and languages are interned: every distinct name
+ * is stored once and movies refer to it by a small integer ID. Years and ratings live in
+ * parallel arrays, so sorting and filtering read dense memory instead of whole records.
+ */
+#include <cstdint>
+
+class MovieStore {
     /**
-     * @brief Constructor to initialize the inverted index.
-     * @param numShards The number of shards to create.
+     * @brief A string in the arena.
      */
-    InvertedIndex(size_t numShards) : shardCount(numShards), shardMutexes(numShards) {
-        shards.resize(numShards);
+    struct Span {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    std::string arena;                             ///< Titles, overviews and poster URLs.
+    std::vector<Span> titles, overviews, posters;  ///< Per-movie strings in the arena.
+    std::vector<int> years;                        ///< Release year per movie.
+    std::vector<float> ratings;                    ///< Rating per movie.
+    std::vector<uint32_t> languageIds;             ///< Interned language per movie.
+    std::vector<uint32_t> genreStart{0};           ///< Genres of movie i are genreIds[genreStart[i], genreStart[i + 1]).
+    std::vector<uint32_t> genreIds;                ///< Interned genres of all movies.
+    std::vector<std::string> genreNames, languageNames;                   ///< Names by interned ID.
+    std::unordered_map<std::string, uint32_t> genreLookup, languageLookup; ///< Interned ID by name.
+
+    Span store(std::string_view text) {
+        Span span{arena.size(), static_cast<uint32_t>(text.size())};
+        arena.append(text.data(), text.size());
+        return span;
+    }
+
+    std::string_view view(const Span &span) const {
+        return std::string_view(arena.data() + span.offset, span.length);
+    }
+
+    static uint32_t intern(std::unordered_map<std::string, uint32_t> &lookup, std::vector<std::string> &names,
+                           std::string_view name) {
+        auto inserted = lookup.emplace(std::string(name), static_cast<uint32_t>(names.size()));
+        if (inserted.second) names.emplace_back(name);
+        return inserted.first->second;
     }
 
+public:
     /**
-     * @brief Convert a string to lowercase.
-     * @param str The input string.
-     * @return A lowercase version of the input string.
+     * @brief Store a movie.
+     * @param movie The parsed record; its strings are copied.
+     * @return The ID of the movie.
      */
-    static std::string toLower(const std::string &str) {
-        std::string lowerStr = str;
-        std::transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(), ::tolower);
-        return lowerStr;
+    int add(const Movie &movie) {
+        int id = static_cast<int>(years.size());
+        titles.push_back(store(movie.title));
+        overviews.push_back(store(movie.overview));
+        posters.push_back(store(movie.posterUrl));
+        years.push_back(movie.year);
+        ratings.push_back(movie.rating);
+        languageIds.push_back(intern(languageLookup, languageNames, movie.language));
+        for (std::string_view genre : movie.genres) {
+            genreIds.push_back(intern(genreLookup, genreNames, genre));
+        }
+        genreStart.push_back(static_cast<uint32_t>(genreIds.size()));
+        return id;
     }
 
     /**
-     * @brief Clean a word by removing punctuation and leading/trailing spaces.
-     * @param word The input word.
-     * @return The cleaned word.
+     * @brief Append all movies of another store; they get the next IDs in their order.
+     * @param other The store to copy, e.g. one filled by a parse thread.
      */
-    static std::string cleanWord(const std::string &word) {
-        std::string clean = word;
-        clean.erase(0, clean.find_first_not_of(" \".,:;!?()[]{}<>"));
-        if (!clean.empty()) {
-            clean.erase(clean.find_last_not_of(" \".,:;!?()[]{}<>") + 1);
+    void append(const MovieStore &other) {
+        std::vector<uint32_t> genreMap, languageMap;
+        for (const std::string &name : other.genreNames) genreMap.push_back(intern(genreLookup, genreNames, name));
+        for (const std::string &name : other.languageNames) {
+            languageMap.push_back(intern(languageLookup, languageNames, name));
         }
-        return clean;
+
+        uint64_t base = arena.size();
+        arena += other.arena;
+        for (const Span &span : other.titles) titles.push_back({base + span.offset, span.length});
+        for (const Span &span : other.overviews) overviews.push_back({base + span.offset, span.length});
+        for (const Span &span : other.posters) posters.push_back({base + span.offset, span.length});
+        years.insert(years.end(), other.years.begin(), other.years.end());
+        ratings.insert(ratings.end(), other.ratings.begin(), other.ratings.end());
+        for (uint32_t language : other.languageIds) languageIds.push_back(languageMap[language]);
+
+        uint32_t genreBase = static_cast<uint32_t>(genreIds.size());
+        for (uint32_t genre : other.genreIds) genreIds.push_back(genreMap[genre]);
+        for (size_t i = 1; i < other.genreStart.size(); ++i) genreStart.push_back(genreBase + other.genreStart[i]);
     }
 
     /**
-     * @brief Add a movie ID to the index under a specific key.
-     * @param key The key for indexing.
-     * @param movieId The movie ID to add.
+     * @brief Reserve arena room for more text.
+     * @param bytes The number of title, overview and URL bytes expected to be added.
      */
-    void addToIndex(const std::string& key, int movieId) {
-        size_t shardIndex = getShardIndex(key);
-        std::lock_guard<std::mutex> lock(shardMutexes[shardIndex]);
-        shards[shardIndex][key].insert(movieId);
+    void reserveText(size_t bytes) {
+        arena.reserve(arena.size() + bytes);
     }
 
+    size_t size() const { return years.size(); }
+    std::string_view title(int id) const { return view(titles[id]); }
+    std::string_view overview(int id) const { return view(overviews[id]); }
+    std::string_view posterUrl(int id) const { return view(posters[id]); }
+    int year(int id) const { return years[id]; }
+    float rating(int id) const { return ratings[id]; }
+    std::string_view language(int id) const { return languageNames[languageIds[id]]; }
+    size_t genreCount(int id) const { return genreStart[id + 1] - genreStart[id]; }
+    std::string_view genre(int id, size_t index) const { return genreNames[genreIds[genreStart[id] + index]]; }
+
     /**
-     * @brief Index a movie by its attributes.
-     * @param id The movie ID.
-     * @param movie The movie object.
+     * @brief The years of all movies, indexed by movie ID.
+     */
+    const std::vector<int> &yearColumn() const { return years; }
+
+    /**
+     * @brief The ratings of all movies, indexed by movie ID.
+     */
+    const std::vector<float> &ratingColumn() const { return ratings; }
+
+    /**
+     * @brief The distinct genre names.
+     */
+    const std::vector<std::string> &genreTable() const { return genreNames; }
+
+    /**
+     * @brief The distinct language names.
+     */
+    const std::vector<std::string> &languageTable() const { return languageNames; }
+
+    /**
+     * @brief Get the heap memory used by the store.
+     * @return The number of bytes owned by the columns and intern tables.
+     */
+    size_t memoryUsage() const {
+        size_t total = arena.capacity() + (titles.capacity() + overviews.capacity() + posters.capacity()) * sizeof(Span) +
+                       years.capacity() * sizeof(int) + ratings.capacity() * sizeof(float) +
+                       (languageIds.capacity() + genreStart.capacity() + genreIds.capacity()) * sizeof(uint32_t);
+        for (const std::string &name : genreNames) total += name.capacity();
+        for (const std::string &name : languageNames) total += name.capacity();
+        return total;
+    }
+
+    /**
+     * @brief Write the columns and intern tables to a snapshot.
      */
-    void addMovie(int id, const Movie &movie) {
-        for (const auto& genre : movie.genres) {
-            std::istringstream stream(genre);
-            std::string word;
-            while (stream >> word) {
-                addToIndex("genre_" + toLower(word), id);
+    void save(SnapshotWriter &out) const {
+        out.write(arena);
+        out.write(titles);
+        out.write(overviews);
+        out.write(posters);
+        out.write(years);
+        out.write(ratings);
+        out.write(languageIds);
+        out.write(genreStart);
+        out.write(genreIds);
+        out.write(genreNames);
+        out.write(languageNames);
+    }
+
+    /**
+     * @brief Replace the contents with a store read from a snapshot.
+     * @return False if the encoded columns are truncated or inconsistent with each other.
+     */
+    bool load(SnapshotReader &in) {
+        if (!in.read(arena) || !in.read(titles) || !in.read(overviews) || !in.read(posters) || !in.read(years) ||
+            !in.read(ratings) || !in.read(languageIds) || !in.read(genreStart) || !in.read(genreIds) ||
+            !in.read(genreNames) || !in.read(languageNames)) {
+            return false;
+        }
+        size_t count = years.size();
+        if (titles.size() != count || overviews.size() != count || posters.size() != count ||
+            ratings.size() != count || languageIds.size() != count || genreStart.size() != count + 1 ||
+            genreStart.front() != 0 || genreStart.back() != genreIds.size()) {
+            return false;
+        }
+        for (const std::vector<Span> *column : {&titles, &overviews, &posters}) {
+            for (const Span &span : *column) {
+                if (span.offset > arena.size() || span.length > arena.size() - span.offset) return false;
             }
         }
-        addToIndex("year_" + std::to_string(movie.year), id);
-        addToIndex("language_" + toLower(movie.language), id);
-        for (int i = static_cast<int>(movie.rating); i <= 10; ++i) {
-            addToIndex("rating_" + std::to_string(i), id);
+        for (size_t i = 0; i < count; ++i) {
+            if (genreStart[i] > genreStart[i + 1] || languageIds[i] >= languageNames.size()) return false;
+        }
+        for (uint32_t genre : genreIds) {
+            if (genre >= genreNames.size()) return false;
         }
 
-        auto processText = [&](const std::string &text, const std::string &category) {
-            std::istringstream stream(text);
-            std::string word;
-            while (stream >> word) {
-                word = toLower(cleanWord(word));
-                if (!word.empty()) {
-                    addToIndex(category + word, id);
-                }
-            }
-        };
+        genreLookup.clear();
+        languageLookup.clear();
+        for (size_t i = 0; i < genreNames.size(); ++i) genreLookup.emplace(genreNames[i], static_cast<uint32_t>(i));
+        for (size_t i = 0; i < languageNames.size(); ++i) {
+            languageLookup.emplace(languageNames[i], static_cast<uint32_t>(i));
+        }
+        return true;
+    }
+};
+
+
 
-        processText(movie.title, "title_");
-        processText(movie.overview, "overview_");
+/**
+ * @brief A sorted, compressed list of movie IDs for a single index key.
+ *
+ * While the index is being built, IDs are appended to a plain vector. Once
+ * `finalize` is called the IDs are sorted, deduplicated and encoded as blocks
+ * of `BLOCK_SIZE` delta-varint values. A small skip table keeps the first ID
+ * and the byte offset of every block, so a block can be decoded on its own.
+ *
+ * Lists that cover at least 1/`BITMAP_DENSITY` of the movies (most genre,
+ * language and rating keys) are stored as a bitset sized to the movie count
+ * instead, so they can be combined with word-wide AND/OR.
+ */
+#include <cstdint>
+#include <bit>
+
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+    static constexpr size_t BITMAP_DENSITY = 16;
+
+    /**
+     * @brief Append a movie ID while the index is being built.
+     * @param movieId The movie ID to add.
+     */
+    void add(int movieId) {
+        pending.push_back(movieId);
     }
 
     /**
-     * @brief Search the index by category and value.
-     * @param category The category to search (e.g., "genre").
-     * @param value The specific value within the category (e.g., "Action").
-     * @return A set of movie IDs matching the query.
+     * @brief Sort, deduplicate and encode the pending IDs.
+     *
+     * IDs that were already encoded are kept, so a list can be finalized again
+     * after more IDs have been added.
+     *
+     * @param universe The number of movies in the index; 0 disables bitmaps.
      */
-    std::unordered_set<int> searchByCategory(const std::string& category, const std::string& value) {
-        std::unordered_set<int> results;
-        std::string key = category + "_" + toLower(value);
+    void finalize(size_t universe = 0) {
+        if (pending.empty()) return;
+        if (count != 0) {
+            std::vector<int> all;
+            decode(all);
+            pending.insert(pending.begin(), all.begin(), all.end());
+        }
+        if (!std::is_sorted(pending.begin(), pending.end())) {
+            std::sort(pending.begin(), pending.end());
+        }
+        pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
 
-        size_t shardIndex = getShardIndex(key);
-        std::lock_guard<std::mutex> lock(shardMutexes[shardIndex]);
-        if (shards[shardIndex].find(key) != shards[shardIndex].end()) {
-            results = shards[shardIndex][key];
+        bytes.clear();
+        blocks.clear();
+        bits.clear();
+        count = pending.size();
+        if (universe != 0 && count * BITMAP_DENSITY >= universe) {
+            bits.assign((std::max(universe, static_cast<size_t>(pending.back()) + 1) + 63) / 64, 0);
+            for (int id : pending) {
+                bits[id >> 6] |= uint64_t{1} << (id & 63);
+            }
+            bytes.shrink_to_fit();
+            blocks.shrink_to_fit();
+            std::vector<int>().swap(pending);
+            return;
         }
-        return results;
+        bits.shrink_to_fit();
+        for (size_t i = 0; i < count; ++i) {
+            if (i % BLOCK_SIZE == 0) {
+                blocks.push_back({pending[i], static_cast<uint32_t>(bytes.size())});
+                continue;
+            }
+            uint32_t delta = static_cast<uint32_t>(pending[i] - pending[i - 1]);
+            while (delta >= 0x80) {
+                bytes.push_back(static_cast<uint8_t>(delta | 0x80));
+                delta >>= 7;
+            }
+            bytes.push_back(static_cast<uint8_t>(delta));
+        }
+        bytes.shrink_to_fit();
+        blocks.shrink_to_fit();
+        std::vector<int>().swap(pending);
     }
 
     /**
-     * @brief Search the index using multiple keywords.
-     * @param keys A vector of keywords to search for.
-     * @return A set of movie IDs matching all keywords.
+     * @brief Get the number of encoded IDs.
+     * @return The number of movie IDs in the list.
      */
-    std::unordered_set<int> searchByKeywords(const std::vector<std::string> &keys) {
-        std::unordered_set<int> currentResults;
-        bool isFirst = true;
+    size_t size() const {
+        return count;
+    }
 
-        for (const auto &key : keys) {
-            std::string cleanedKey = toLower(cleanWord(key));
-            std::unordered_set<int> keyResults;
+    /**
+     * @brief Check whether the list is stored as a bitset.
+     * @return True for bitmap lists, false for block-encoded lists.
+     */
+    bool isBitmap() const {
+        return !bits.empty();
+    }
 
-            size_t shardIndex = getShardIndex(cleanedKey);
-            std::lock_guard<std::mutex> lock(shardMutexes[shardIndex]);
+    /**
+     * @brief Get the bitset words of a bitmap list.
+     * @return The words, bit `id % 64` of word `id / 64` set for every ID.
+     */
+    const std::vector<uint64_t> &bitmap() const {
+        return bits;
+    }
 
-            for (const std::string &category : {"title_", "overview_", "genre_", "language_", "year_", "rating_"}) {
-                std::string fullKey = category + cleanedKey;
-                if (shards[shardIndex].find(fullKey) != shards[shardIndex].end()) {
-                    keyResults.insert(shards[shardIndex][fullKey].begin(), shards[shardIndex][fullKey].end());
-                }
-            }
+    /**
+     * @brief Check whether a bitmap list contains an ID.
+     * @param movieId The movie ID to test.
+     * @return True if the ID is in the list.
+     */
+    bool testBit(int movieId) const {
+        size_t word = static_cast<size_t>(movieId) >> 6;
+        return word < bits.size() && (bits[word] >> (movieId & 63) & 1);
+    }
 
-            if (isFirst) {
-                currentResults = keyResults;
-                isFirst = false;
-            } else {
-                std::unordered_set<int> intersection;
-                for (int id : currentResults) {
-                    if (keyResults.find(id) != keyResults.end()) {
-                        intersection.insert(id);
-                    }
-                }
-                currentResults = intersection;
-            }
+    /**
+     * @brief Get the number of encoded blocks.
+     * @return The number of blocks in the skip table.
+     */
+    size_t blockCount() const {
+        return blocks.size();
+    }
 
-            if (currentResults.empty()) {
-                break;
-            }
+    /**
+     * @brief Decode a single block.
+     * @param block The index of the block to decode.
+     * @param out Destination with room for at least `BLOCK_SIZE` IDs.
+     * @return The number of IDs written to `out`.
+     */
+    size_t decodeBlock(size_t block, int *out) const {
+        size_t n = (block + 1 == blocks.size()) ? count - block * BLOCK_SIZE : BLOCK_SIZE;
+        const uint8_t *p = bytes.data() + blocks[block].offset;
+        int value = blocks[block].firstId;
+        out[0] = value;
+        for (size_t i = 1; i < n; ++i) {
+            uint32_t delta = 0;
+            int shift = 0;
+            uint8_t byte;
+            do {
+                byte = *p++;
+                delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            value += static_cast<int>(delta);
+            out[i] = value;
         }
-
-        return currentResults;
+        return n;
     }
 
     /**
-     * @brief Compute the intersection of two result sets.
-     * @param baseResults The base set of results.
-     * @param additionalResults The additional set of results.
-     * @return A set containing the intersection of the two input sets.
+     * @brief Decode the whole list.
+     * @param out The vector to fill with the sorted movie IDs.
      */
-    std::unordered_set<int> intersectResults(const std::unordered_set<int> &baseResults, const std::unordered_set<int> &additionalResults) {
-        std::unordered_set<int> intersection;
-        for (int id : baseResults) {
-            if (additionalResults.find(id) != additionalResults.end()) {
-                intersection.insert(id);
+    void decode(std::vector<int> &out) const {
+        if (isBitmap()) {
+            out.clear();
+            out.reserve(count);
+            for (size_t w = 0; w < bits.size(); ++w) {
+                for (uint64_t word = bits[w]; word; word &= word - 1) {
+                    out.push_back(static_cast<int>(w * 64 + std::countr_zero(word)));
+                }
             }
+            return;
+        }
+        out.resize(count);
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            decodeBlock(b, out.data() + b * BLOCK_SIZE);
         }
-        return intersection;
     }
 
     /**
-     * @brief Clear all data from the index.
+     * @brief Get the heap memory used by the encoded list.
+     * @return The number of bytes owned by the list.
      */
-    void clear() {
-        for (size_t i = 0; i < shardCount; ++i) {
-            std::lock_guard<std::mutex> lock(shardMutexes[i]);
-            shards[i].clear();
-        }
+    size_t memoryUsage() const {
+        return bytes.capacity() + blocks.capacity() * sizeof(Block) + bits.capacity() * sizeof(uint64_t) +
+               pending.capacity() * sizeof(int);
     }
 
     /**
-     * @brief Provide access to the raw index data.
-     * @return A constant reference to the index.
+     * @brief Write the encoded list to a snapshot; the list must be finalized.
      */
-    const std::vector<std::unordered_map<std::string, std::unordered_set<int>>> &getIndexData() const {
-        return shards;
+    void save(SnapshotWriter &out) const {
+        out.write(uint64_t{count});
+        out.write(bytes);
+        out.write(blocks);
+        out.write(bits);
     }
-};
 
-InvertedIndex invertedIndex(8);
-std::vector<Movie> movies;
-std::unordered_set<std::string> genres, languages;
-std::set<int> years;
-std::set<float> ratings;
+    /**
+     * @brief Replace the list with one read from a snapshot.
+     * @return False if the encoding is truncated or its skip table does not match the ID count.
+     */
+    bool load(SnapshotReader &in) {
+        uint64_t storedCount;
+        if (!in.read(storedCount) || !in.read(bytes) || !in.read(blocks) || !in.read(bits)) return false;
+        count = static_cast<size_t>(storedCount);
+        pending.clear();
+        if (!bits.empty()) return bytes.empty() && blocks.empty();
+        if (blocks.size() != (count + BLOCK_SIZE - 1) / BLOCK_SIZE) return false;
+        for (const Block &block : blocks) {
+            if (block.offset > bytes.size()) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Forward-only iterator over a block-encoded list.
+     *
+     * `seek` gallops over the skip table first and only decodes the block that
+     * can contain the target, so probing a long list with a few IDs touches
+     * only a few blocks. Bitmap lists are probed with `testBit` instead.
+     */
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList &list) : list(list) {}
+
+        /**
+         * @brief Move to the first ID that is greater than or equal to `target`.
+         * @param target The ID to search for.
+         * @return False if the list has no such ID.
+         */
+        bool seek(int target) {
+            const std::vector<Block> &blocks = list.blocks;
+            if (block >= blocks.size()) return false;
+            if (loaded == 0 || buffer[loaded - 1] < target) {
+                // Gallop over the skip table to the last block starting at or before the target.
+                size_t lo = block, step = 1, hi = block + 1;
+                while (hi < blocks.size() && blocks[hi].firstId <= target) {
+                    lo = hi;
+                    step *= 2;
+                    hi = lo + step;
+                }
+                hi = std::min(hi, blocks.size());
+                size_t upper = std::upper_bound(blocks.begin() + lo, blocks.begin() + hi, target,
+                                                [](int value, const Block &b) { return value < b.firstId; }) -
+                               blocks.begin();
+                size_t next = upper > block ? upper - 1 : block;
+                if (next != block || loaded == 0) {
+                    block = next;
+                    loaded = list.decodeBlock(block, buffer);
+                    pos = 0;
+                }
+                if (buffer[loaded - 1] < target) {
+                    // The target falls between this block and the next one.
+                    if (++block >= blocks.size()) return false;
+                    loaded = list.decodeBlock(block, buffer);
+                    pos = 0;
+                    return true;
+                }
+            }
+            pos = std::lower_bound(buffer + pos, buffer + loaded, target) - buffer;
+            return true;
+        }
+
+        /**
+         * @brief Get the ID the cursor currently points at.
+         * @return The current movie ID.
+         */
+        int value() const {
+            return buffer[pos];
+        }
+
+    private:
+        const PostingList &list;
+        size_t block = 0;   ///< Index of the decoded block.
+        size_t loaded = 0;  ///< Number of IDs in `buffer`.
+        size_t pos = 0;     ///< Current position in `buffer`.
+        int buffer[BLOCK_SIZE];
+    };
+
+private:
+    struct Block {
+        int firstId;      ///< First movie ID of the block, stored uncompressed.
+        uint32_t offset;  ///< Offset of the block's deltas in `bytes`.
+    };
+
+    std::vector<int> pending;   ///< IDs added since the last `finalize`.
+    std::vector<uint8_t> bytes; ///< Delta-varint encoded IDs.
+    std::vector<Block> blocks;  ///< Skip table with one entry per block.
+    std::vector<uint64_t> bits; ///< Bitset storage for dense lists.
+    size_t count = 0;           ///< Number of encoded IDs.
+};
 
 /**
- * @brief Loads movie data from a file, processes it in parallel, and updates global data structures.
- *
- * This function divides the input file into chunks, processes each chunk using multiple threads,
- * and combines the results into global variables for movies, genres, languages, years, and ratings.
- * It also builds an inverted index for efficient searching.
+ * @brief Intersects sorted posting lists for multi-term queries.
  *
- * @param filePath Path to the input CSV file containing movie data.
- * @param numThreads Number of threads to use for parallel processing.
+ * Operands are collected with `addList`/`addUnion` and evaluated by `run`,
+ * smallest first. Bitmap operands are ANDed word by word; array operands are
+ * either probed with a galloping search when they are much longer than the
+ * running result, or merged with a SIMD block-compare kernel (AVX2 or SSE2
+ * when the compiler targets them, plain scalar code otherwise). Buffers are
+ * kept between calls so a reused engine does not allocate on every query.
  */
-void loadMovies(const std::string &filePath, size_t numThreads) {
-    // Open the file in binary mode to determine its size.
-    std::ifstream file(filePath, std::ios::ate | std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: Unable to open file!" << std::endl;
-        return;
-    }
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
-    size_t fileSize = file.tellg(); // Get the size of the file.
-    file.close();
+class IntersectionEngine {
+public:
+    /// Size ratio above which the longer operand is probed instead of merged.
+    static constexpr size_t GALLOP_RATIO = 32;
 
-    // Calculate chunk size for each thread.
-    size_t chunkSize = fileSize / numThreads;
+    /**
+     * @brief Remove all operands so the engine can be reused.
+     */
+    void clear() {
+        operands.clear();
+        unionsUsed = 0;
+        bitUnionsUsed = 0;
+    }
 
-    // Temporary structures to store thread-specific results.
-    std::vector<std::vector<Movie>> threadMovies(numThreads);
-    std::vector<std::unordered_set<std::string>> threadGenres(numThreads);
-    std::vector<std::unordered_set<std::string>> threadLanguages(numThreads);
-    std::vector<std::set<int>> threadYears(numThreads);
-    std::vector<std::set<float>> threadRatings(numThreads);
+    /**
+     * @brief Add a posting list that every result must be contained in.
+     * @param list The posting list, or nullptr if the key does not exist.
+     */
+    void addList(const PostingList *list) {
+        if (list && list->isBitmap()) {
+            operands.push_back({nullptr, -1, list->size(), list->bitmap().data(), list->bitmap().size()});
+        } else {
+            operands.push_back({list, -1, list ? list->size() : 0, nullptr, 0});
+        }
+    }
 
-    // Lambda function for processing a chunk of the file.
-    auto processChunk = [&](size_t threadId, size_t startPos, size_t endPos) {
-        std::ifstream inFile(filePath);
-        inFile.seekg(startPos); // Move to the starting position of the chunk.
-
-        std::string line;
-        if (startPos != 0) {
-            std::getline(inFile, line); // Skip partial line at the beginning of the chunk.
-        }
-
-        // Read and process each line within the chunk's range.
-        while (std::getline(inFile, line) && inFile.tellg() <= static_cast<std::streampos>(endPos)) {
-            std::vector<std::string> fields;
-            std::string current;
-            bool inQuotes = false;
-
-            // Parse the CSV line, handling quoted fields.
-            for (char c: line) {
-                if (c == '"') {
-                    inQuotes = !inQuotes;
-                } else if (c == ',' && !inQuotes) {
-                    fields.push_back(current);
-                    current.clear();
+    /**
+     * @brief Add an operand that matches the union of several posting lists.
+     *
+     * If any of the lists is a bitmap the union is built as a bitmap with
+     * word-wide OR; otherwise the lists are merged into a sorted array.
+     *
+     * @param lists The posting lists to combine; an empty vector matches nothing.
+     */
+    void addUnion(const std::vector<const PostingList *> &lists) {
+        if (lists.size() <= 1) {
+            addList(lists.empty() ? nullptr : lists.front());
+            return;
+        }
+        size_t words = 0;
+        for (const PostingList *list : lists) {
+            words = std::max(words, list->bitmap().size());
+        }
+        if (words != 0) {
+            if (bitUnionsUsed == bitUnions.size()) bitUnions.emplace_back();
+            std::vector<uint64_t> &bits = bitUnions[bitUnionsUsed++];
+            bits.assign(words, 0);
+            for (const PostingList *list : lists) {
+                if (list->isBitmap()) {
+                    const std::vector<uint64_t> &other = list->bitmap();
+                    for (size_t w = 0; w < other.size(); ++w) bits[w] |= other[w];
                 } else {
-                    current += c;
-                }
-            }
-            fields.push_back(current); // Add the last field.
-
-            if (fields.size() < 9) continue; // Skip malformed lines.
-
-            Movie movie{static_cast<int>(threadMovies[threadId].size())}; // Create a new movie.
-            try {
-                // Populate the movie fields.
-                movie.year = fields[0].empty() ? 0 : stoi(fields[0].substr(0, 4));
-                movie.title = fields[1];
-                movie.overview = fields[2];
-                movie.rating = fields[5].empty() ? 0.0f : stof(fields[5]);
-                movie.language = fields[6];
-                movie.posterUrl = fields[8];
-
-                // Parse and clean genres.
-                std::istringstream genreStream(fields[7]);
-                std::string genre;
-                while (getline(genreStream, genre, ',')) {
-                    genre.erase(0, genre.find_first_not_of(" \""));
-                    genre.erase(genre.find_last_not_of(" \"") + 1);
-                    if (!genre.empty()) {
-                        movie.genres.push_back(genre);
-                        threadGenres[threadId].insert(genre);
+                    list->decode(decoded);
+                    for (int id : decoded) {
+                        size_t w = static_cast<size_t>(id) >> 6;
+                        if (w >= bits.size()) bits.resize(w + 1, 0);
+                        bits[w] |= uint64_t{1} << (id & 63);
                     }
                 }
-            } catch (...) {
-                continue; // Skip malformed lines.
             }
+            size_t size = 0;
+            for (uint64_t word : bits) size += std::popcount(word);
+            operands.push_back({nullptr, -1, size, bits.data(), bits.size()});
+            return;
+        }
 
-            // Validate and add the movie to thread-specific results.
-            if (!movie.title.empty() && !movie.overview.empty() && !movie.genres.empty() &&
-                movie.year != 0 && movie.rating > 0.0f) {
-                threadMovies[threadId].push_back(movie);
-                threadYears[threadId].insert(movie.year);
-                threadRatings[threadId].insert(movie.rating);
-                threadLanguages[threadId].insert(movie.language);
+        if (unionsUsed == unions.size()) unions.emplace_back();
+        std::vector<int> &ids = unions[unionsUsed];
+        ids.clear();
+        if (lists.size() > 2) {
+            // Many lists, e.g. an expanded keyword: one sort is cheaper than repeated pairwise merges.
+            for (const PostingList *list : lists) {
+                list->decode(decoded);
+                ids.insert(ids.end(), decoded.begin(), decoded.end());
+            }
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        } else {
+            for (const PostingList *list : lists) {
+                list->decode(decoded);
+                scratch.clear();
+                std::set_union(ids.begin(), ids.end(), decoded.begin(), decoded.end(), std::back_inserter(scratch));
+                ids.swap(scratch);
             }
         }
-    };
-
-    // Launch threads to process chunks.
-    std::vector<std::thread> threads;
-    for (size_t i = 0; i < numThreads; ++i) {
-        size_t startPos = i * chunkSize;
-        size_t endPos = (i == numThreads - 1) ? fileSize : startPos + chunkSize;
-        threads.emplace_back(processChunk, i, startPos, endPos);
+        operands.push_back({nullptr, static_cast<int>(unionsUsed), ids.size(), nullptr, 0});
+        ++unionsUsed;
     }
 
-    for (auto &thread : threads) {
-        thread.join(); // Wait for all threads to finish.
-    }
+    /**
+     * @brief Intersect all operands.
+     * @param out The vector to fill with the sorted matching movie IDs.
+     */
+    void run(std::vector<int> &out) {
+        out.clear();
+        if (operands.empty()) return;
+        std::sort(operands.begin(), operands.end(),
+                  [](const Operand &a, const Operand &b) { return a.size < b.size; });
+        if (operands.front().size == 0) return;
 
-    // Merge results from all threads into global variables.
-    movies.clear();
-    genres.clear();
-    languages.clear();
-    years.clear();
-    ratings.clear();
+        const Operand *firstArray = nullptr, *firstBitmap = nullptr;
+        for (const Operand &op : operands) {
+            if (op.bits && !firstBitmap) firstBitmap = &op;
+            if (!op.bits && !firstArray) firstArray = &op;
+        }
 
-    for (size_t i = 0; i < numThreads; ++i) {
-        movies.insert(movies.end(), threadMovies[i].begin(), threadMovies[i].end());
-        genres.insert(threadGenres[i].begin(), threadGenres[i].end());
-        languages.insert(threadLanguages[i].begin(), threadLanguages[i].end());
-        years.insert(threadYears[i].begin(), threadYears[i].end());
-        ratings.insert(threadRatings[i].begin(), threadRatings[i].end());
+        if (firstBitmap && (!firstArray || firstBitmap->size < firstArray->size)) {
+            // Start from the AND of every bitmap, then narrow it down with the arrays.
+            andBitmaps(out);
+            for (const Operand &op : operands) {
+                if (out.empty()) break;
+                if (!op.bits) intersectWith(op, out);
+            }
+        } else {
+            materialize(*firstArray, out);
+            for (const Operand &op : operands) {
+                if (out.empty()) break;
+                if (&op != firstArray) intersectWith(op, out);
+            }
+        }
     }
 
-    // Rebuild the inverted index using the loaded movies.
-    invertedIndex.clear();
-    for (size_t i = 0; i < movies.size(); ++i) {
-        invertedIndex.addMovie(i, movies[i]);
+    /**
+     * @brief Estimate the work of `addUnion` for some lists: bitmap words ORed plus IDs decoded.
+     */
+    static size_t unionCost(const std::vector<const PostingList *> &lists) {
+        size_t cost = 0;
+        for (const PostingList *list : lists) {
+            cost += list->isBitmap() ? list->bitmap().size() : list->size();
+        }
+        return cost;
     }
 
-    std::cout << "Movies loaded and indexed successfully with " << numThreads << " threads." << std::endl;
-}
+    /**
+     * @brief Estimate the work of `filterByUnion` for some lists and `count` IDs.
+     *
+     * A bitmap is tested once per ID; a cursor decodes at most one block per ID and never more
+     * than the whole list.
+     */
+    static size_t probeCost(const std::vector<const PostingList *> &lists, size_t count) {
+        size_t cost = 0;
+        for (const PostingList *list : lists) {
+            cost += list->isBitmap() ? count : std::min(list->size(), count * PostingList::BLOCK_SIZE) + count;
+        }
+        return cost;
+    }
 
-/**
- * @brief Handles client requests and sends appropriate responses.
- *
- * This function processes incoming HTTP requests from clients, including GET and POST requests.
- * - **GET**: Responds with an HTML form for movie search.
- * - **POST**: Processes search parameters, queries the inverted index, and returns search results.
- * - **SEARCH**: (Custom command) Performs a keyword-based search and returns results in plain text.
+    /**
+     * @brief Keep the IDs that occur in at least one of several posting lists.
+     *
+     * The alternative to `addUnion` for a few IDs: every list is probed for them, bitmaps with
+     * `testBit` and block-encoded lists with a cursor, so no list is decoded whole or merged.
+     *
+     * @param ids Sorted movie IDs; the ones in none of the lists are removed.
+     * @param lists The posting lists to probe.
+     */
+    static void filterByUnion(std::vector<int> &ids, const std::vector<const PostingList *> &lists) {
+        thread_local std::vector<uint8_t> found;
+        found.assign(ids.size(), 0);
+        for (const PostingList *list : lists) {
+            if (list->isBitmap()) {
+                for (size_t i = 0; i < ids.size(); ++i) found[i] |= list->testBit(ids[i]);
+                continue;
+            }
+            PostingList::Cursor cursor(*list);
+            for (size_t i = 0; i < ids.size() && cursor.seek(ids[i]); ++i) found[i] |= cursor.value() == ids[i];
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (found[i]) ids[kept++] = ids[i];
+        }
+        ids.resize(kept);
+    }
+
+    /**
+     * @brief Intersect two sorted arrays of unique IDs.
+     * @param a The first array.
+     * @param na The length of the first array.
+     * @param b The second array.
+     * @param nb The length of the second array.
+     * @param out Destination with room for `min(na, nb)` IDs.
+     * @return The number of IDs written to `out`.
+     */
+    static size_t intersectSorted(const int *a, size_t na, const int *b, size_t nb, int *out) {
+        size_t i = 0, j = 0, k = 0;
+#if defined(__AVX2__)
+        while (i + 8 <= na && j + 8 <= nb) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+            __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+            __m256i match = _mm256_cmpeq_epi32(va, vb);
+            for (int r = 1; r < 8; ++r) {
+                vb = _mm256_permutevar8x32_epi32(vb, rotate);
+                match = _mm256_or_si256(match, _mm256_cmpeq_epi32(va, vb));
+            }
+            k = compact(a + i, static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(match))), out, k);
+            int maxA = a[i + 7], maxB = b[j + 7];
+            if (maxA <= maxB) i += 8;
+            if (maxB <= maxA) j += 8;
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        while (i + 4 <= na && j + 4 <= nb) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+            __m128i match = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                                 _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+                    _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                                 _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+            k = compact(a + i, static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(match))), out, k);
+            int maxA = a[i + 3], maxB = b[j + 3];
+            if (maxA <= maxB) i += 4;
+            if (maxB <= maxA) j += 4;
+        }
+#endif
+        // Scalar merge for the tail (or the whole input without SIMD support).
+        while (i < na && j < nb) {
+            if (a[i] < b[j]) {
+                ++i;
+            } else if (b[j] < a[i]) {
+                ++j;
+            } else {
+                out[k++] = a[i];
+                ++i;
+                ++j;
+            }
+        }
+        return k;
+    }
+
+private:
+    struct Operand {
+        const PostingList *list; ///< Block-encoded operand, or nullptr.
+        int unionIndex;          ///< Index into `unions` for merged array unions, or -1.
+        size_t size;             ///< Number of IDs in the operand.
+        const uint64_t *bits;    ///< Bitset words for bitmap operands, or nullptr.
+        size_t words;            ///< Number of words in `bits`.
+    };
+
+    std::vector<Operand> operands;
+    std::vector<std::vector<int>> unions;          ///< Array unions, reused between queries.
+    size_t unionsUsed = 0;
+    std::vector<std::vector<uint64_t>> bitUnions;  ///< Bitmap unions, reused between queries.
+    size_t bitUnionsUsed = 0;
+    std::vector<uint64_t> andBits;
+    std::vector<int> decoded;
+    std::vector<int> scratch;
+
+    /**
+     * @brief Copy the IDs selected by a comparison mask to the output.
+     */
+    static size_t compact(const int *block, unsigned mask, int *out, size_t k) {
+        while (mask) {
+            out[k++] = block[std::countr_zero(mask)];
+            mask &= mask - 1;
+        }
+        return k;
+    }
+
+    /**
+     * @brief Decode an array operand into a plain sorted vector.
+     */
+    void materialize(const Operand &op, std::vector<int> &out) {
+        if (op.list) {
+            op.list->decode(out);
+        } else {
+            out = unions[op.unionIndex];
+        }
+    }
+
+    /**
+     * @brief AND every bitmap operand and extract the IDs of the set bits.
+     */
+    void andBitmaps(std::vector<int> &out) {
+        size_t words = SIZE_MAX;
+        for (const Operand &op : operands) {
+            if (op.bits) words = std::min(words, op.words);
+        }
+        andBits.assign(words, ~uint64_t{0});
+        for (const Operand &op : operands) {
+            if (!op.bits) continue;
+            for (size_t w = 0; w < words; ++w) andBits[w] &= op.bits[w];
+        }
+        out.clear();
+        for (size_t w = 0; w < words; ++w) {
+            for (uint64_t word = andBits[w]; word; word &= word - 1) {
+                out.push_back(static_cast<int>(w * 64 + std::countr_zero(word)));
+            }
+        }
+    }
+
+    /**
+     * @brief Keep only the results contained in an operand.
+     */
+    void intersectWith(const Operand &op, std::vector<int> &results) {
+        if (op.bits) {
+            size_t kept = 0;
+            for (int id : results) {
+                size_t w = static_cast<size_t>(id) >> 6;
+                if (w < op.words && (op.bits[w] >> (id & 63) & 1)) results[kept++] = id;
+            }
+            results.resize(kept);
+        } else if (op.size / results.size() >= GALLOP_RATIO) {
+            gallop(op, results);
+        } else {
+            const std::vector<int> &ids = op.list ? (op.list->decode(decoded), decoded) : unions[op.unionIndex];
+            scratch.resize(std::min(results.size(), ids.size()));
+            scratch.resize(intersectSorted(results.data(), results.size(), ids.data(), ids.size(), scratch.data()));
+            results.swap(scratch);
+        }
+    }
+
+    /**
+     * @brief Keep only the results found in a much longer array operand.
+     */
+    void gallop(const Operand &op, std::vector<int> &results) {
+        size_t kept = 0;
+        if (op.list) {
+            PostingList::Cursor cursor(*op.list);
+            for (int id : results) {
+                if (!cursor.seek(id)) break;
+                if (cursor.value() == id) results[kept++] = id;
+            }
+        } else {
+            const std::vector<int> &ids = unions[op.unionIndex];
+            size_t lo = 0;
+            for (int id : results) {
+                size_t step = 1, hi = lo;
+                while (hi < ids.size() && ids[hi] < id) {
+                    lo = hi;
+                    hi += step;
+                    step *= 2;
+                }
+                hi = std::min(hi + 1, ids.size());
+                lo = std::lower_bound(ids.begin() + lo, ids.begin() + hi, id) - ids.begin();
+                if (lo == ids.size()) break;
+                if (ids[lo] == id) results[kept++] = id;
+            }
+        }
+        results.resize(kept);
+    }
+};
+
+/**
+ * @brief The number of words in the title and overview of every movie, which BM25 normalizes by.
+ */
+#include <array>
+#include <cmath>
+#include <limits>
+
+struct TextStatistics {
+    std::vector<std::array<uint16_t, 2>> lengths; ///< Title and overview word counts, indexed by movie ID.
+    double averageTitle = 0;                      ///< Mean title length over all movies.
+    double averageOverview = 0;                   ///< Mean overview length over all movies.
+
+    /**
+     * @brief Recompute the mean lengths after movies were added.
+     */
+    void update() {
+        double title = 0, overview = 0;
+        for (const auto &length : lengths) {
+            title += length[0];
+            overview += length[1];
+        }
+        averageTitle = lengths.empty() ? 0 : title / lengths.size();
+        averageOverview = lengths.empty() ? 0 : overview / lengths.size();
+    }
+};
+
+/**
+ * @brief The movies whose title or overview contains a word, with the word's BM25 score in each.
+ *
+ * Beside the sorted movie IDs the list keeps how often the word occurs in each field, so the
+ * scores (impacts) can be recomputed when more movies change the collection statistics. The
+ * fields are combined BM25F-style: the length-normalized frequencies are weighted and summed
+ * before saturation, so a word in the title counts `TITLE_WEIGHT` times as much as one in the
+ * overview. The highest impact of every `BLOCK_SIZE` postings is kept for block-max pruning.
+ */
+class ImpactList {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;
+    static constexpr double K1 = 1.2;          ///< Term frequency saturation.
+    static constexpr double B = 0.75;          ///< Strength of the length normalization.
+    static constexpr double TITLE_WEIGHT = 3.0;
+
+    /**
+     * @brief Append a movie while the index is being built; IDs must be added in increasing order.
+     * @param movieId The movie ID.
+     * @param titleFrequency Occurrences of the word in the title.
+     * @param overviewFrequency Occurrences of the word in the overview.
+     */
+    void add(int movieId, size_t titleFrequency, size_t overviewFrequency) {
+        ids.push_back(movieId);
+        frequencies.push_back({static_cast<uint8_t>(std::min<size_t>(titleFrequency, 255)),
+                               static_cast<uint8_t>(std::min<size_t>(overviewFrequency, 255))});
+    }
+
+    /**
+     * @brief Compute the impact of every posting and the block maxima.
+     * @param text The lengths of all indexed movies; every ID of the list must be covered.
+     */
+    void computeImpacts(const TextStatistics &text) {
+        double documents = static_cast<double>(text.lengths.size());
+        double idf = std::log(1.0 + (documents - ids.size() + 0.5) / (ids.size() + 0.5));
+        impacts.resize(ids.size());
+        blockMaxima.assign((ids.size() + BLOCK_SIZE - 1) / BLOCK_SIZE, 0.0f);
+        maximum = 0;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const auto &length = text.lengths[ids[i]];
+            double frequency =
+                    TITLE_WEIGHT * frequencies[i][0] / (1 - B + B * length[0] / std::max(text.averageTitle, 1.0)) +
+                    frequencies[i][1] / (1 - B + B * length[1] / std::max(text.averageOverview, 1.0));
+            impacts[i] = static_cast<float>(idf * frequency * (K1 + 1) / (frequency + K1));
+            blockMaxima[i / BLOCK_SIZE] = std::max(blockMaxima[i / BLOCK_SIZE], impacts[i]);
+            maximum = std::max(maximum, impacts[i]);
+        }
+    }
+
+    /**
+     * @brief Get the number of movies in the list.
+     */
+    size_t size() const {
+        return ids.size();
+    }
+
+    /**
+     * @brief Get the movie ID at a position.
+     */
+    int id(size_t pos) const {
+        return ids[pos];
+    }
+
+    /**
+     * @brief Get the score of the word in the movie at a position.
+     */
+    float impact(size_t pos) const {
+        return impacts[pos];
+    }
+
+    /**
+     * @brief Get the highest impact of the whole list, an upper bound of its score contribution.
+     */
+    float maxImpact() const {
+        return maximum;
+    }
+
+    /**
+     * @brief Get the highest impact of the block holding a position.
+     */
+    float blockMax(size_t pos) const {
+        return blockMaxima[pos / BLOCK_SIZE];
+    }
+
+    /**
+     * @brief Get the last ID of the block holding a position.
+     */
+    int blockLastId(size_t pos) const {
+        return ids[std::min(pos / BLOCK_SIZE * BLOCK_SIZE + BLOCK_SIZE, ids.size()) - 1];
+    }
+
+    /**
+     * @brief Find the first position at or after `pos` whose ID is not less than `target`, galloping.
+     * @return The position, or `size()` if there is none.
+     */
+    size_t seek(size_t pos, int target) const {
+        size_t step = 1, hi = pos;
+        while (hi < ids.size() && ids[hi] < target) {
+            pos = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        return std::lower_bound(ids.begin() + pos, ids.begin() + std::min(hi, ids.size()), target) - ids.begin();
+    }
+
+    /**
+     * @brief Get the heap memory used by the list.
+     * @return The number of bytes owned by the list.
+     */
+    size_t memoryUsage() const {
+        return ids.capacity() * sizeof(int) + frequencies.capacity() * 2 + impacts.capacity() * sizeof(float) +
+               blockMaxima.capacity() * sizeof(float);
+    }
+
+    /**
+     * @brief Write the list and its impacts to a snapshot.
+     */
+    void save(SnapshotWriter &out) const {
+        out.write(ids);
+        out.write(frequencies);
+        out.write(impacts);
+        out.write(blockMaxima);
+        out.write(maximum);
+    }
+
+    /**
+     * @brief Replace the list with one read from a snapshot.
+     * @return False if the snapshot is truncated, the arrays do not match in size or the IDs are not increasing.
+     */
+    bool load(SnapshotReader &in) {
+        if (!in.read(ids) || !in.read(frequencies) || !in.read(impacts) || !in.read(blockMaxima) ||
+            !in.read(maximum)) {
+            return false;
+        }
+        return frequencies.size() == ids.size() && impacts.size() == ids.size() &&
+               blockMaxima.size() == (ids.size() + BLOCK_SIZE - 1) / BLOCK_SIZE &&
+               std::adjacent_find(ids.begin(), ids.end(), [](int a, int b) { return a >= b; }) == ids.end();
+    }
+
+private:
+    std::vector<int> ids;                             ///< Movie IDs in increasing order.
+    std::vector<std::array<uint8_t, 2>> frequencies;  ///< Title and overview occurrences per movie, capped at 255.
+    std::vector<float> impacts;                       ///< BM25 score of the word per movie.
+    std::vector<float> blockMaxima;                   ///< Highest impact of each block.
+    float maximum = 0;                                ///< Highest impact of the list.
+};
+
+/**
+ * @brief Selects the best scored movies of a result set with block-max WAND.
+ *
+ * The score of a movie is the sum of the impacts of the query's words in it. Lists are walked
+ * document at a time, ordered by their current ID. A movie is only scored when the highest
+ * possible impacts of the lists that can contain it (first the list maxima, then the maxima of
+ * the blocks holding it) beat the K-th best score found so far; everything up to the next
+ * promising movie is skipped. The result set acts as a filter: lists skip right to its next
+ * member. Common words have small impacts, so once K good movies are found their long lists
+ * are mostly skipped instead of scanned.
+ */
+class RankingEngine {
+public:
+    /**
+     * @brief Remove the lists of the previous query.
+     */
+    void clear() {
+        cursors.clear();
+    }
+
+    /**
+     * @brief Add the impact list of a query word; a list added twice counts once.
+     */
+    void addList(const ImpactList *list) {
+        if (!list || list->size() == 0) return;
+        for (const Cursor &cursor : cursors) {
+            if (cursor.list == list) return;
+        }
+        cursors.push_back({list, 0});
+    }
+
+    /**
+     * @brief Order the best movies of a result set by score.
+     *
+     * Ties are broken by movie ID. Movies of the result set that none of the lists contain
+     * score zero and follow the scored ones in ID order.
+     *
+     * @param candidates The sorted result set to rank.
+     * @param limit The number of movies to produce.
+     * @param out Receives the first `limit` movies of `candidates` in order of decreasing score.
+     */
+    void run(const std::vector<int> &candidates, size_t limit, std::vector<int> &out) {
+        out.clear();
+        limit = std::min(limit, candidates.size());
+        if (limit == 0) return;
+
+        std::vector<Scored> best; // A heap with the worst of the best movies on top.
+        size_t candidate = 0;
+        while (true) {
+            // Keep the cursors ordered by their current ID; the exhausted ones are dropped.
+            for (size_t i = 0; i < cursors.size();) {
+                if (cursors[i].pos >= cursors[i].list->size()) {
+                    cursors[i] = cursors.back();
+                    cursors.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+            std::sort(cursors.begin(), cursors.end(), [](const Cursor &a, const Cursor &b) { return a.id() < b.id(); });
+            double threshold = best.size() < limit ? 0.0 : best.front().score;
+
+            // The pivot is the first list at which the summed maxima can beat the threshold: no
+            // movie before its ID can, as only the lists in front of it can contain such a movie.
+            size_t pivot = 0;
+            double bound = 0;
+            for (; pivot < cursors.size(); ++pivot) {
+                bound += cursors[pivot].list->maxImpact();
+                if (bound > threshold) break;
+            }
+            if (pivot == cursors.size()) break;
+            int pivotId = cursors[pivot].id();
+            while (pivot + 1 < cursors.size() && cursors[pivot + 1].id() == pivotId) ++pivot;
+
+            // Only members of the result set count.
+            candidate = gallop(candidates, candidate, pivotId);
+            if (candidate == candidates.size()) break;
+            if (candidates[candidate] != pivotId) {
+                advance(candidates[candidate]);
+                continue;
+            }
+
+            // Tighter bound: the maxima of the blocks that would hold the pivot.
+            double blockBound = 0;
+            int blockEnd = std::numeric_limits<int>::max();
+            for (size_t i = 0; i <= pivot; ++i) {
+                Cursor &cursor = cursors[i];
+                cursor.pos = cursor.list->seek(cursor.pos, pivotId);
+                if (cursor.pos == cursor.list->size()) continue;
+                blockBound += cursor.list->blockMax(cursor.pos);
+                blockEnd = std::min(blockEnd, cursor.list->blockLastId(cursor.pos));
+            }
+            if (blockBound <= threshold) {
+                // No movie is promising before one of these blocks ends or the next list starts.
+                if (pivot + 1 < cursors.size()) blockEnd = std::min(blockEnd, cursors[pivot + 1].id() - 1);
+                if (blockEnd == std::numeric_limits<int>::max()) continue;
+                advance(blockEnd + 1);
+                continue;
+            }
+
+            double score = 0; // Exact for a few floats, so it does not depend on the order of the lists.
+            for (size_t i = 0; i <= pivot; ++i) {
+                Cursor &cursor = cursors[i];
+                if (cursor.pos < cursor.list->size() && cursor.id() == pivotId) {
+                    score += cursor.list->impact(cursor.pos);
+                    ++cursor.pos;
+                }
+            }
+            if (score > threshold) {
+                best.push_back({score, pivotId});
+                std::push_heap(best.begin(), best.end(), better);
+                if (best.size() > limit) {
+                    std::pop_heap(best.begin(), best.end(), better);
+                    best.pop_back();
+                }
+            }
+        }
+
+        std::sort_heap(best.begin(), best.end(), better);
+        for (const Scored &movie : best) out.push_back(movie.id);
+        if (out.size() < limit) {
+            // Every positive score beat the zero threshold, so the remaining candidates scored zero.
+            std::vector<int> scored(out);
+            std::sort(scored.begin(), scored.end());
+            for (size_t i = 0; i < candidates.size() && out.size() < limit; ++i) {
+                if (!std::binary_search(scored.begin(), scored.end(), candidates[i])) out.push_back(candidates[i]);
+            }
+        }
+    }
+
+private:
+    struct Cursor {
+        const ImpactList *list;
+        size_t pos; ///< Position of the current posting in the list.
+
+        int id() const {
+            return list->id(pos);
+        }
+    };
+
+    struct Scored {
+        double score;
+        int id;
+    };
+
+    /// Orders movies best first: higher score, then lower ID.
+    static bool better(const Scored &a, const Scored &b) {
+        return a.score > b.score || (a.score == b.score && a.id < b.id);
+    }
+
+    /**
+     * @brief Find the first position at or after `pos` of a sorted vector whose value is not less than `target`.
+     */
+    static size_t gallop(const std::vector<int> &values, size_t pos, int target) {
+        size_t step = 1, hi = pos;
+        while (hi < values.size() && values[hi] < target) {
+            pos = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        return std::lower_bound(values.begin() + pos, values.begin() + std::min(hi, values.size()), target) -
+               values.begin();
+    }
+
+    /**
+     * @brief Move every cursor that is before an ID to the first posting at or after it.
+     */
+    void advance(int target) {
+        for (Cursor &cursor : cursors) {
+            if (cursor.pos < cursor.list->size() && cursor.id() < target) {
+                cursor.pos = cursor.list->seek(cursor.pos, target);
+            }
+        }
+    }
+
+    std::vector<Cursor> cursors;
+};
+
+/**
+ * @brief An inverted index for efficient movie search.
+ *
+ * This class maps keywords and attributes (e.g., genres, language, title) to
+ * sorted posting lists of movie IDs, allowing fast and flexible search operations.
+ * The index is a term dictionary sharded by word: each word maps to one posting
+ * list handle per category it occurs in, so all categories of a word are found
+ * with a single hash probe. Adding movies is thread-safe; once `finalize` has been
+ * called the index is treated as immutable and searched without any locking.
+ */
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <algorithm>
+#include <string_view>
+#include <charconv>
+#include <functional>
+
+class InvertedIndex {
+public:
+    /**
+     * @brief The movie attributes a word can be indexed under.
+     */
+    enum Category { Title, Overview, Genre, Language, Year, Rating, CATEGORY_COUNT };
+
+    /**
+     * @brief String hash that also accepts `std::string_view`, so dictionary lookups need no temporary key.
+     */
+    struct TermHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view word) const {
+            return std::hash<std::string_view>()(word);
+        }
+    };
+
+    /**
+     * @brief A word-keyed map that can be searched with a `std::string_view`.
+     */
+    template <typename T>
+    using TermMap = std::unordered_map<std::string, T, TermHash, std::equal_to<>>;
+
+    /**
+     * @brief The posting list handles of one word: an index into the shard's lists per category, or -1.
+     */
+    struct Term {
+        std::array<int32_t, CATEGORY_COUNT> lists;
+        int32_t impacts = -1; ///< Index into the shard's impact lists if the word occurs in a title or overview.
+
+        Term() {
+            lists.fill(-1);
+        }
+    };
+
+private:
+    /**
+     * @brief The words whose hash selects this shard, and their posting lists.
+     */
+    struct Shard {
+        TermMap<Term> terms;
+        std::vector<PostingList> lists;
+        std::vector<ImpactList> impacts;
+    };
+
+    std::vector<Shard> shards;
+    std::vector<std::mutex> shardMutexes;
+    size_t shardCount;
+    TextStatistics text; ///< Title and overview lengths of the movies built by `addToPartial`.
+
+    /**
+     * @brief A word of the sorted dictionary: its bytes in `lexiconWords` and its posting lists.
+     */
+    struct LexiconEntry {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t shard; ///< The shard holding the word's posting lists.
+        Term term;
+    };
+
+    std::string lexiconWords;          ///< All words in sorted order, back to back.
+    std::vector<LexiconEntry> lexicon; ///< One entry per word, sorted by word; built by `buildLexicon`, updated by `extendLexicon`.
+
+    std::string_view lexiconWord(size_t index) const {
+        return std::string_view(lexiconWords.data() + lexicon[index].offset, lexicon[index].length);
+    }
+
+    /**
+     * @brief Find the lexicon words within an edit distance of a word, walking the sorted words as a trie.
+     *
+     * The words in [lo, hi) share their first `depth` bytes, and `rows` holds one row of the
+     * edit distance table per depth: row `depth` has the distances between that shared prefix and
+     * every prefix of `query`. A run of words with the same next byte is a child of the trie node,
+     * and children whose row has no entry within `maxDistance` are skipped with all their words.
+     */
+    void collectFuzzy(std::string_view query, int maxDistance, size_t lo, size_t hi, size_t depth,
+                      std::vector<int> &rows, std::vector<size_t> &matches) const {
+        size_t width = query.size() + 1;
+        // The words that end here sort first; shorter ones cannot share the prefix and are skipped.
+        for (; lo < hi && lexiconWord(lo).size() <= depth; ++lo) {
+            if (lexiconWord(lo).size() == depth && rows[depth * width + query.size()] <= maxDistance) {
+                matches.push_back(lo);
+            }
+        }
+        if (rows.size() < (depth + 2) * width) rows.resize((depth + 2) * width);
+        while (lo < hi) {
+            char byte = lexiconWord(lo)[depth];
+            size_t end = std::partition_point(lexicon.begin() + lo, lexicon.begin() + hi, [&](const LexiconEntry &entry) {
+                return lexiconWords[entry.offset + depth] == byte;
+            }) - lexicon.begin();
+
+            const int *row = rows.data() + depth * width;
+            int *next = rows.data() + (depth + 1) * width;
+            next[0] = row[0] + 1;
+            int best = next[0];
+            for (size_t j = 1; j < width; ++j) {
+                next[j] = std::min({next[j - 1] + 1, row[j] + 1, row[j - 1] + (query[j - 1] != byte)});
+                best = std::min(best, next[j]);
+            }
+            if (best <= maxDistance) collectFuzzy(query, maxDistance, lo, end, depth + 1, rows, matches);
+            lo = end;
+        }
+    }
+
+    /**
+     * @brief Get the shard index for a given word.
+     * @param word The word to hash for determining the shard.
+     * @return The index of the shard.
+     */
+    size_t getShardIndex(std::string_view word) const {
+        return TermHash()(word) % shardCount;
+    }
+
+    /**
+     * @brief Get the posting list of a word in a category, creating it if needed.
+     */
+    static PostingList &listFor(Shard &shard, Term &term, int category) {
+        if (term.lists[category] < 0) {
+            term.lists[category] = static_cast<int32_t>(shard.lists.size());
+            shard.lists.emplace_back();
+        }
+        return shard.lists[term.lists[category]];
+    }
+
+    /**
+     * @brief Split a key such as "genre_action" into its category and word.
+     * @return False if the key does not start with a known category.
+     */
+    static bool splitKey(std::string_view key, int &category, std::string_view &word) {
+        size_t separator = key.find('_');
+        category = separator == std::string_view::npos ? -1 : categoryIndex(key.substr(0, separator));
+        if (category < 0) return false;
+        word = key.substr(separator + 1);
+        return true;
+    }
+
+    /**
+     * @brief Add a movie ID to the posting list of a word in one category.
+     */
+    void addWord(int category, std::string_view word, int movieId) {
+        size_t shardIndex = getShardIndex(word);
+        std::lock_guard<std::mutex> lock(shardMutexes[shardIndex]);
+        Shard &shard = shards[shardIndex];
+        auto it = shard.terms.find(word);
+        if (it == shard.terms.end()) it = shard.terms.try_emplace(std::string(word)).first;
+        listFor(shard, it->second, category).add(movieId);
+    }
+
+public:
+    /**
+     * @brief Constructor to initialize the inverted index.
+     * @param numShards The number of shards to create.
+     */
+    InvertedIndex(size_t numShards) : shardMutexes(numShards), shardCount(numShards) {
+        shards.resize(numShards);
+    }
+
+    /**
+     * @brief Copy the posting lists of another index, e.g. to extend a published snapshot.
+     * @param other The index to copy; it must not be modified concurrently.
+     */
+    InvertedIndex(const InvertedIndex &other)
+            : shards(other.shards), shardMutexes(other.shardCount), shardCount(other.shardCount),
+              text(other.text), lexiconWords(other.lexiconWords), lexicon(other.lexicon) {
+    }
+
+    /**
+     * @brief Get the name of a category as used in index keys.
+     */
+    static const char *categoryName(int category) {
+        static const char *names[CATEGORY_COUNT] = {"title", "overview", "genre", "language", "year", "rating"};
+        return names[category];
+    }
+
+    /**
+     * @brief Find a category by name.
+     * @return The category, or -1 if the name is unknown.
+     */
+    static int categoryIndex(std::string_view name) {
+        for (int category = 0; category < CATEGORY_COUNT; ++category) {
+            if (name == categoryName(category)) return category;
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Take the next token from a text.
+     * @param text The remaining text; advanced past the token.
+     * @param delimiters The characters that separate tokens.
+     * @return The token, or an empty view if only delimiters were left.
+     */
+    static std::string_view nextToken(std::string_view &text, std::string_view delimiters = " \t\n\v\f\r") {
+        size_t begin = text.find_first_not_of(delimiters);
+        if (begin == std::string_view::npos) {
+            text = std::string_view();
+            return text;
+        }
+        size_t end = std::min(text.find_first_of(delimiters, begin), text.size());
+        std::string_view token = text.substr(begin, end - begin);
+        text.remove_prefix(end);
+        return token;
+    }
+
+    /**
+     * @brief Lowercase a word into a buffer.
+     *
+     * ASCII letters and the two-byte UTF-8 capitals of Latin-1 and Cyrillic are lowered;
+     * all other bytes, including the rest of multi-byte sequences, are copied unchanged.
+     *
+     * @param word The input word.
+     * @param buffer Receives the lowercase word.
+     * @return A view of `buffer`.
+     */
+    static std::string_view lowercase(std::string_view word, std::string &buffer) {
+        buffer.assign(word.data(), word.size());
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            unsigned char c = buffer[i];
+            if (c >= 'A' && c <= 'Z') {
+                buffer[i] = static_cast<char>(c + ('a' - 'A'));
+            } else if (c >= 0xC0 && i + 1 < buffer.size() && (buffer[i + 1] & 0xC0) == 0x80) {
+                unsigned char next = buffer[++i];
+                if (c == 0xC3 && next <= 0x9E && next != 0x97) {       // À-Þ except ×
+                    buffer[i] = static_cast<char>(next + 0x20);
+                } else if (c == 0xD0 && next >= 0x90 && next <= 0x9F) { // А-П
+                    buffer[i] = static_cast<char>(next + 0x20);
+                } else if (c == 0xD0 && next >= 0xA0 && next <= 0xAF) { // Р-Я
+                    buffer[i - 1] = static_cast<char>(0xD1);
+                    buffer[i] = static_cast<char>(next - 0x20);
+                } else if (c == 0xD0 && next <= 0x8F) {                 // Ѐ-Џ
+                    buffer[i - 1] = static_cast<char>(0xD1);
+                    buffer[i] = static_cast<char>(next + 0x10);
+                }
+            }
+        }
+        return buffer;
+    }
+
+    /**
+     * @brief Convert a string to lowercase.
+     * @param str The input string.
+     * @return A lowercase version of the input string.
+     */
+    static std::string toLower(std::string_view str) {
+        std::string lowerStr;
+        lowercase(str, lowerStr);
+        return lowerStr;
+    }
+
+    /**
+     * @brief Turn a token into an indexed word: strip surrounding punctuation and spaces, then lowercase it.
+     * @param word The input token.
+     * @param buffer Receives the cleaned word.
+     * @return A view of `buffer`; empty if the token was only punctuation.
+     */
+    static std::string_view normalizeWord(std::string_view word, std::string &buffer) {
+        const std::string_view punctuation = " \".,:;!?()[]{}<>";
+        size_t first = word.find_first_not_of(punctuation);
+        if (first == std::string_view::npos) {
+            buffer.clear();
+            return buffer;
+        }
+        return lowercase(word.substr(first, word.find_last_not_of(punctuation) - first + 1), buffer);
+    }
+
+    /**
+     * @brief Add a movie ID to the index under a specific key.
+     * @param key The key for indexing, e.g. "title_batman".
+     * @param movieId The movie ID to add.
+     */
+    void addToIndex(std::string_view key, int movieId) {
+        int category;
+        std::string_view word;
+        if (splitKey(key, category, word)) addWord(category, word, movieId);
+    }
+
+    /**
+     * @brief Call a function for every indexed word of a movie.
+     *
+     * Words are produced in a reused thread-local buffer, so tokenizing allocates nothing
+     * once the buffer has grown to the longest word.
+     *
+     * @param movies The store holding the movie.
+     * @param id The movie ID within the store.
+     * @param emit Called with each category and word; the word is only valid during the call,
+     *             and a pair may be emitted more than once.
+     */
+    template <typename Emit>
+    static void forEachKey(const MovieStore &movies, int id, Emit &&emit) {
+        thread_local std::string buffer;
+        for (size_t i = 0; i < movies.genreCount(id); ++i) {
+            std::string_view genre = movies.genre(id, i);
+            for (std::string_view token = nextToken(genre); !token.empty(); token = nextToken(genre)) {
+                emit(Genre, lowercase(token, buffer));
+            }
+        }
+        char number[16];
+        emit(Year, std::string_view(number, std::to_chars(number, number + sizeof(number), movies.year(id)).ptr - number));
+        if (!movies.language(id).empty()) emit(Language, lowercase(movies.language(id), buffer));
+        for (int i = static_cast<int>(movies.rating(id)); i <= 10; ++i) {
+            emit(Rating, std::string_view(number, std::to_chars(number, number + sizeof(number), i).ptr - number));
+        }
+
+        auto processText = [&](std::string_view text, Category category) {
+            for (std::string_view token = nextToken(text); !token.empty(); token = nextToken(text)) {
+                std::string_view word = normalizeWord(token, buffer);
+                if (!word.empty()) {
+                    emit(category, word);
+                }
+            }
+        };
+
+        processText(movies.title(id), Title);
+        processText(movies.overview(id), Overview);
+    }
+
+    /**
+     * @brief Index a movie by its attributes.
+     * @param movies The store holding the movie.
+     * @param id The movie ID.
+     */
+    void addMovie(const MovieStore &movies, int id) {
+        forEachKey(movies, id, [&](Category category, std::string_view word) {
+            addWord(category, word, id);
+        });
+    }
+
+    /**
+     * @brief Word to per-category movie ID lists built by a single thread, split by shard.
+     *
+     * IDs are local to the thread (0, 1, 2, ... in the order its movies were
+     * added) and are offset to global IDs when the partial index is merged.
+     * Title and overview lists repeat an ID once per occurrence of the word.
+     */
+    struct PartialIndex {
+        std::vector<TermMap<std::array<std::vector<int>, CATEGORY_COUNT>>> shards;
+        std::vector<std::array<uint16_t, 2>> lengths; ///< Title and overview word counts by local ID.
+    };
+
+    /**
+     * @brief Index a movie into a thread-local partial index without locking.
+     * @param partial The partial index owned by the calling thread.
+     * @param movies The thread's movies.
+     * @param localId The movie's ID in `movies`, which is also its ID local to the partial index.
+     */
+    void addToPartial(PartialIndex &partial, const MovieStore &movies, int localId) const {
+        partial.shards.resize(shardCount);
+        partial.lengths.resize(localId + 1);
+        std::array<uint16_t, 2> &length = partial.lengths[localId];
+        length = {0, 0};
+        forEachKey(movies, localId, [&](Category category, std::string_view word) {
+            auto &terms = partial.shards[getShardIndex(word)];
+            auto it = terms.find(word);
+            if (it == terms.end()) it = terms.try_emplace(std::string(word)).first;
+            std::vector<int> &ids = it->second[category];
+            if (category == Title || category == Overview) {
+                // Every occurrence is kept: the runs of equal IDs are the term frequencies.
+                if (length[category] < UINT16_MAX) ++length[category];
+                ids.push_back(localId);
+            } else if (ids.empty() || ids.back() != localId) {
+                ids.push_back(localId);
+            }
+        });
+    }
+
+    /**
+     * @brief Add the text lengths of several partial indexes, before their shards are merged.
+     * @param partials The partial indexes built by the parse tasks.
+     * @param firstIds The global ID of the first movie of each partial index.
+     */
+    void mergeTextLengths(const std::vector<PartialIndex> &partials, const std::vector<int> &firstIds) {
+        for (size_t t = 0; t < partials.size(); ++t) {
+            const auto &lengths = partials[t].lengths;
+            if (text.lengths.size() < firstIds[t] + lengths.size()) text.lengths.resize(firstIds[t] + lengths.size());
+            std::copy(lengths.begin(), lengths.end(), text.lengths.begin() + firstIds[t]);
+        }
+        text.update();
+    }
+
+    /**
+     * @brief Merge one shard of several partial indexes into the index and finalize it.
+     *
+     * Each shard can be merged by its own thread without locking, as long as no two
+     * threads merge the same shard. Partial indexes must be passed in movie order, and
+     * `mergeTextLengths` must have been called for them, since the impacts of all the
+     * shard's words are recomputed from the new collection statistics.
+     *
+     * @param shardIndex The shard to merge.
+     * @param partials The partial indexes built by the parse tasks.
+     * @param firstIds The global ID of the first movie of each partial index.
+     * @param universe The number of indexed movies, used to size bitmap lists.
+     */
+    void mergeShard(size_t shardIndex, const std::vector<PartialIndex> &partials,
+                    const std::vector<int> &firstIds, size_t universe) {
+        Shard &shard = shards[shardIndex];
+        for (size_t t = 0; t < partials.size(); ++t) {
+            if (partials[t].shards.empty()) continue;
+            for (const auto &entry : partials[t].shards[shardIndex]) {
+                Term &term = shard.terms[entry.first];
+                for (int category = 0; category < CATEGORY_COUNT; ++category) {
+                    if (entry.second[category].empty()) continue;
+                    PostingList &list = listFor(shard, term, category);
+                    for (int id : entry.second[category]) {
+                        list.add(firstIds[t] + id);
+                    }
+                }
+
+                // Count the runs of equal IDs in the title and overview lists, merged by ID.
+                const std::vector<int> &title = entry.second[Title], &overview = entry.second[Overview];
+                if (title.empty() && overview.empty()) continue;
+                if (term.impacts < 0) {
+                    term.impacts = static_cast<int32_t>(shard.impacts.size());
+                    shard.impacts.emplace_back();
+                }
+                ImpactList &impacts = shard.impacts[term.impacts];
+                for (size_t i = 0, j = 0; i < title.size() || j < overview.size();) {
+                    int id = std::min(i < title.size() ? title[i] : std::numeric_limits<int>::max(),
+                                      j < overview.size() ? overview[j] : std::numeric_limits<int>::max());
+                    size_t titleFrequency = 0, overviewFrequency = 0;
+                    for (; i < title.size() && title[i] == id; ++i) ++titleFrequency;
+                    for (; j < overview.size() && overview[j] == id; ++j) ++overviewFrequency;
+                    impacts.add(firstIds[t] + id, titleFrequency, overviewFrequency);
+                }
+            }
+        }
+        for (PostingList &list : shard.lists) {
+            list.finalize(universe);
+        }
+        for (ImpactList &impacts : shard.impacts) {
+            impacts.computeImpacts(text);
+        }
+    }
+
+    /**
+     * @brief Get the number of shards.
+     * @return The shard count given to the constructor.
+     */
+    size_t getShardCount() const {
+        return shardCount;
+    }
+
+    /**
+     * @brief Sort and encode every posting list once indexing is complete.
+     * @param universe The number of indexed movies, used to size bitmap lists.
+     */
+    void finalize(size_t universe) {
+        for (size_t i = 0; i < shardCount; ++i) {
+            std::lock_guard<std::mutex> lock(shardMutexes[i]);
+            for (PostingList &list : shards[i].lists) {
+                list.finalize(universe);
+            }
+        }
+        buildLexicon();
+    }
+
+    /**
+     * @brief Find the posting list of a word in one category.
+     * @param category The category of the list.
+     * @param word The indexed (lowercase, cleaned) word.
+     * @return The posting list, or nullptr if the word does not occur in the category.
+     */
+    const PostingList *findList(int category, std::string_view word) const {
+        const Shard &shard = shards[getShardIndex(word)];
+        auto it = shard.terms.find(word);
+        if (it == shard.terms.end() || it->second.lists[category] < 0) return nullptr;
+        return &shard.lists[it->second.lists[category]];
+    }
+
+    /**
+     * @brief Find the posting list stored under a key.
+     * @param key The full index key (e.g., "genre_action").
+     * @return The posting list, or nullptr if the key is not indexed.
+     */
+    const PostingList *findList(std::string_view key) const {
+        int category;
+        std::string_view word;
+        return splitKey(key, category, word) ? findList(category, word) : nullptr;
+    }
+
+    /**
+     * @brief Collect the posting lists of a word in every category, with one hash probe.
+     * @param word The indexed (lowercase, cleaned) word.
+     * @param lists Receives the lists; it is not cleared first.
+     */
+    void findTermLists(std::string_view word, std::vector<const PostingList *> &lists) const {
+        const Shard &shard = shards[getShardIndex(word)];
+        auto it = shard.terms.find(word);
+        if (it == shard.terms.end()) return;
+        for (int32_t handle : it->second.lists) {
+            if (handle >= 0) lists.push_back(&shard.lists[handle]);
+        }
+    }
+
+    /// Keywords of at least this many bytes also match the words they are a prefix of.
+    static constexpr size_t MIN_PREFIX_LENGTH = 4;
+    /// Most words a keyword is expanded to besides itself; the words with the most postings are kept.
+    static constexpr size_t MAX_EXPANSIONS = 64;
+
+    /**
+     * @brief Rebuild the sorted dictionary of all words from the shards.
+     *
+     * Called once the posting lists are complete. The shards answer exact lookups; the sorted
+     * dictionary answers prefix and fuzzy ones, since all words with a common prefix are adjacent.
+     */
+    void buildLexicon() {
+        std::vector<std::pair<std::string_view, std::pair<uint32_t, const Term *>>> words;
+        for (size_t i = 0; i < shardCount; ++i) {
+            for (const auto &entry : shards[i].terms) {
+                // An empty word has no first byte, which the prefix and fuzzy lookups rely on.
+                if (!entry.first.empty()) words.push_back({entry.first, {static_cast<uint32_t>(i), &entry.second}});
+            }
+        }
+        std::sort(words.begin(), words.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        size_t bytes = 0;
+        for (const auto &word : words) bytes += word.first.size();
+        lexiconWords.clear();
+        lexiconWords.reserve(bytes);
+        lexicon.clear();
+        lexicon.reserve(words.size());
+        for (const auto &word : words) {
+            lexicon.push_back({static_cast<uint32_t>(lexiconWords.size()), static_cast<uint32_t>(word.first.size()),
+                               word.second.first, *word.second.second});
+            lexiconWords += word.first;
+        }
+    }
+
+    /**
+     * @brief Bring the sorted dictionary up to date after the shards of partial indexes were merged.
+     *
+     * Only the words of the partial indexes are sorted and then merged into the existing
+     * dictionary, so adding a few movies does not sort every word again. The other words
+     * keep their list handles, since merging only touches the words it adds IDs to.
+     *
+     * @param partials The partial indexes passed to `mergeShard`.
+     */
+    void extendLexicon(const std::vector<PartialIndex> &partials) {
+        if (lexicon.empty()) {
+            buildLexicon();
+            return;
+        }
+        std::vector<std::pair<std::string_view, uint32_t>> added; // Word and shard.
+        for (const PartialIndex &partial : partials) {
+            for (size_t i = 0; i < partial.shards.size(); ++i) {
+                for (const auto &entry : partial.shards[i]) {
+                    if (!entry.first.empty()) added.push_back({entry.first, static_cast<uint32_t>(i)});
+                }
+            }
+        }
+        std::sort(added.begin(), added.end());
+        added.erase(std::unique(added.begin(), added.end()), added.end());
+
+        std::string words;
+        std::vector<LexiconEntry> entries;
+        words.reserve(lexiconWords.size() + added.size() * 8);
+        entries.reserve(lexicon.size() + added.size());
+        auto append = [&](std::string_view word, uint32_t shard, const Term &term) {
+            entries.push_back({static_cast<uint32_t>(words.size()), static_cast<uint32_t>(word.size()), shard, term});
+            words += word;
+        };
+        size_t next = 0;
+        for (const auto &word : added) {
+            for (; next < lexicon.size() && lexiconWord(next) < word.first; ++next) {
+                append(lexiconWord(next), lexicon[next].shard, lexicon[next].term);
+            }
+            if (next < lexicon.size() && lexiconWord(next) == word.first) ++next; // Replaced by the updated handles.
+            append(word.first, word.second, shards[word.second].terms.find(word.first)->second);
+        }
+        for (; next < lexicon.size(); ++next) {
+            append(lexiconWord(next), lexicon[next].shard, lexicon[next].term);
+        }
+        lexiconWords.swap(words);
+        lexicon.swap(entries);
+    }
+
+    /**
+     * @brief Call a function for every word a search keyword matches.
+     *
+     * A keyword of at least `MIN_PREFIX_LENGTH` bytes matches every word it is a prefix of, so
+     * "spider" also finds "spider-man"; shorter keywords only match themselves. A keyword that
+     * matches no word at all falls back to the words within a small edit distance of it: one
+     * byte edit for keywords of up to seven bytes, two for longer ones, none below the prefix
+     * length. Besides the keyword itself, at most `MAX_EXPANSIONS` words are used, those with
+     * the most postings first.
+     *
+     * @param keyword The indexed (lowercase, cleaned) keyword.
+     * @param visit Called with the shard holding each matched word and the word's list handles.
+     */
+    template <typename Visit>
+    void forEachKeywordTerm(std::string_view keyword, Visit &&visit) const {
+        if (keyword.size() < MIN_PREFIX_LENGTH || lexicon.empty()) {
+            const Shard &shard = shards[getShardIndex(keyword)];
+            auto it = shard.terms.find(keyword);
+            if (it != shard.terms.end()) visit(shard, it->second);
+            return;
+        }
+
+        std::vector<size_t> matches;
+        auto first = std::lower_bound(lexicon.begin(), lexicon.end(), keyword, [&](const LexiconEntry &entry, std::string_view word) {
+            return std::string_view(lexiconWords.data() + entry.offset, entry.length) < word;
+        });
+        auto last = std::partition_point(first, lexicon.end(), [&](const LexiconEntry &entry) {
+            return std::string_view(lexiconWords.data() + entry.offset, entry.length).starts_with(keyword);
+        });
+        for (auto it = first; it != last; ++it) matches.push_back(it - lexicon.begin());
+
+        if (matches.empty() && keyword.size() <= 64) {
+            // Typo tolerance, for words that start with the same byte as the keyword: typos in the
+            // first letter are rare, and requiring it leaves a single subtree of the trie to walk.
+            size_t width = keyword.size() + 1;
+            thread_local std::vector<int> rows;
+            rows.resize(2 * width);
+            for (size_t j = 0; j < width; ++j) {
+                rows[j] = static_cast<int>(j);                          // From the empty prefix.
+                rows[width + j] = j == 0 ? 1 : static_cast<int>(j) - 1; // From the first byte.
+            }
+            auto begin = std::partition_point(lexicon.begin(), lexicon.end(), [&](const LexiconEntry &entry) {
+                return static_cast<unsigned char>(lexiconWords[entry.offset]) < static_cast<unsigned char>(keyword[0]);
+            });
+            auto end = std::partition_point(begin, lexicon.end(), [&](const LexiconEntry &entry) {
+                return lexiconWords[entry.offset] == keyword[0];
+            });
+            collectFuzzy(keyword, keyword.size() < 8 ? 1 : 2, begin - lexicon.begin(), end - lexicon.begin(), 1, rows,
+                         matches);
+        }
+
+        auto postings = [&](size_t index) {
+            size_t total = 0;
+            const LexiconEntry &entry = lexicon[index];
+            for (int32_t handle : entry.term.lists) {
+                if (handle >= 0) total += shards[entry.shard].lists[handle].size();
+            }
+            return total;
+        };
+        // The keyword itself, if it is a word, sorts first and is never dropped.
+        size_t exact = !matches.empty() && lexiconWord(matches.front()) == keyword ? 1 : 0;
+        if (matches.size() > exact + MAX_EXPANSIONS) {
+            std::nth_element(matches.begin() + exact, matches.begin() + exact + MAX_EXPANSIONS, matches.end(),
+                             [&](size_t a, size_t b) { return postings(a) > postings(b); });
+            matches.resize(exact + MAX_EXPANSIONS);
+        }
+        for (size_t index : matches) {
+            visit(shards[lexicon[index].shard], lexicon[index].term);
+        }
+    }
+
+    /**
+     * @brief Collect the posting lists a search keyword matches, in every category.
+     * @param keyword The indexed (lowercase, cleaned) keyword; see `forEachKeywordTerm` for what it matches.
+     * @param lists Receives the lists; it is not cleared first.
+     */
+    void findKeywordLists(std::string_view keyword, std::vector<const PostingList *> &lists) const {
+        forEachKeywordTerm(keyword, [&](const Shard &shard, const Term &term) {
+            for (int32_t handle : term.lists) {
+                if (handle >= 0) lists.push_back(&shard.lists[handle]);
+            }
+        });
+    }
+
+    /**
+     * @brief Order a result set by the BM25 relevance of its movies to search keywords.
+     *
+     * Every word a keyword matches contributes its impact, so prefix and typo matches are scored
+     * like the words themselves.
+     *
+     * @param keywords The indexed (lowercase, cleaned) keywords.
+     * @param results The sorted result set of the search.
+     * @param limit The number of movies to produce.
+     * @param out Receives the `limit` most relevant movies of `results`, best first.
+     */
+    void rankByRelevance(const std::vector<std::string> &keywords, const std::vector<int> &results, size_t limit,
+                         std::vector<int> &out) const {
+        thread_local RankingEngine engine;
+        engine.clear();
+        for (const auto &keyword : keywords) {
+            forEachKeywordTerm(keyword, [&](const Shard &shard, const Term &term) {
+                if (term.impacts >= 0) engine.addList(&shard.impacts[term.impacts]);
+            });
+        }
+        engine.run(results, limit, out);
+    }
+
+    /**
+     * @brief Search the index by category and value.
+     * @param category The category to search (e.g., "genre").
+     * @param value The specific value within the category (e.g., "Action").
+     * @return A sorted vector of movie IDs matching the query.
+     */
+    std::vector<int> searchByCategory(const std::string& category, const std::string& value) const {
+        std::vector<int> results;
+        int index = categoryIndex(category);
+        std::string word;
+        const PostingList *list = index < 0 ? nullptr : findList(index, lowercase(value, word));
+        if (list) {
+            list->decode(results);
+        }
+        return results;
+    }
+
+    /**
+     * @brief Search the index using multiple keywords.
+     * @param keys A vector of keywords to search for.
+     * @return A sorted vector of movie IDs matching all keywords, each in any category.
+     */
+    std::vector<int> searchByKeywords(const std::vector<std::string> &keys) const {
+        thread_local IntersectionEngine engine;
+        engine.clear();
+        std::vector<const PostingList *> lists;
+        std::string word;
+
+        for (const auto &key : keys) {
+            lists.clear();
+            findKeywordLists(normalizeWord(key, word), lists);
+            engine.addUnion(lists);
+        }
+
+        std::vector<int> currentResults;
+        engine.run(currentResults);
+        return currentResults;
+    }
+
+    /**
+     * @brief Compute the intersection of two sorted result vectors.
+     * @param baseResults The base set of results.
+     * @param additionalResults The additional set of results.
+     * @return A sorted vector containing the intersection of the two inputs.
+     */
+    std::vector<int> intersectResults(const std::vector<int> &baseResults, const std::vector<int> &additionalResults) const {
+        std::vector<int> intersection(std::min(baseResults.size(), additionalResults.size()));
+        intersection.resize(IntersectionEngine::intersectSorted(baseResults.data(), baseResults.size(),
+                                                                additionalResults.data(), additionalResults.size(),
+                                                                intersection.data()));
+        return intersection;
+    }
+
+    /**
+     * @brief Clear all data from the index.
+     */
+    void clear() {
+        for (size_t i = 0; i < shardCount; ++i) {
+            std::lock_guard<std::mutex> lock(shardMutexes[i]);
+            shards[i].terms.clear();
+            shards[i].lists.clear();
+            shards[i].impacts.clear();
+        }
+        text = TextStatistics();
+        lexiconWords.clear();
+        lexicon.clear();
+    }
+
+    /**
+     * @brief Get the heap memory used by the term dictionary and posting lists.
+     * @return The number of bytes owned by the index.
+     */
+    size_t memoryUsage() const {
+        size_t total = 0;
+        for (size_t i = 0; i < shardCount; ++i) {
+            for (const auto &entry : shards[i].terms) {
+                total += entry.first.capacity() + sizeof(entry);
+            }
+            for (const PostingList &list : shards[i].lists) {
+                total += sizeof(list) + list.memoryUsage();
+            }
+            for (const ImpactList &impacts : shards[i].impacts) {
+                total += sizeof(impacts) + impacts.memoryUsage();
+            }
+        }
+        return total + text.lengths.capacity() * sizeof(text.lengths[0]) + lexiconWords.capacity() +
+               lexicon.capacity() * sizeof(LexiconEntry);
+    }
+
+    /**
+     * @brief Write the term dictionaries and posting lists to a snapshot; the index must be finalized.
+     */
+    void save(SnapshotWriter &out) const {
+        out.write(uint64_t{shardCount});
+        for (const Shard &shard : shards) {
+            out.write(uint64_t{shard.terms.size()});
+            for (const auto &entry : shard.terms) {
+                out.write(entry.first);
+                out.write(entry.second.lists);
+                out.write(entry.second.impacts);
+            }
+            out.write(uint64_t{shard.lists.size()});
+            for (const PostingList &list : shard.lists) {
+                list.save(out);
+            }
+            out.write(uint64_t{shard.impacts.size()});
+            for (const ImpactList &impacts : shard.impacts) {
+                impacts.save(out);
+            }
+        }
+        out.write(text.lengths);
+        out.write(lexiconWords);
+        out.write(lexicon);
+    }
+
+    /**
+     * @brief Replace the contents with an index read from a snapshot.
+     * @return False if the snapshot is truncated, refers to missing lists or movies, or has another shard count.
+     */
+    bool load(SnapshotReader &in) {
+        uint64_t storedShards;
+        if (!in.read(storedShards) || storedShards != shardCount) return false;
+        for (Shard &shard : shards) {
+            uint64_t termCount, listCount, impactCount;
+            if (!in.read(termCount) || termCount > in.remaining()) return false;
+            shard.terms.clear();
+            shard.terms.reserve(static_cast<size_t>(termCount));
+            for (uint64_t i = 0; i < termCount; ++i) {
+                std::string word;
+                Term term;
+                if (!in.read(word) || !in.read(term.lists) || !in.read(term.impacts)) return false;
+                shard.terms.emplace(std::move(word), term);
+            }
+            if (!in.read(listCount) || listCount > in.remaining()) return false;
+            shard.lists.assign(static_cast<size_t>(listCount), PostingList());
+            for (PostingList &list : shard.lists) {
+                if (!list.load(in)) return false;
+            }
+            if (!in.read(impactCount) || impactCount > in.remaining()) return false;
+            shard.impacts.assign(static_cast<size_t>(impactCount), ImpactList());
+            for (ImpactList &impacts : shard.impacts) {
+                if (!impacts.load(in)) return false;
+            }
+            for (const auto &entry : shard.terms) {
+                for (int32_t handle : entry.second.lists) {
+                    if (handle >= static_cast<int64_t>(listCount)) return false;
+                }
+                if (entry.second.impacts >= static_cast<int64_t>(impactCount)) return false;
+            }
+        }
+
+        // Impacts are recomputed from the lengths when movies are appended, so every ID needs one.
+        if (!in.read(text.lengths)) return false;
+        text.update();
+        for (const Shard &shard : shards) {
+            for (const ImpactList &impacts : shard.impacts) {
+                if (impacts.size() != 0 && (impacts.id(0) < 0 || impacts.id(impacts.size() - 1) >=
+                                            static_cast<int64_t>(text.lengths.size()))) {
+                    return false;
+                }
+            }
+        }
+
+        if (!in.read(lexiconWords) || !in.read(lexicon)) return false;
+        for (const LexiconEntry &entry : lexicon) {
+            if (entry.length == 0 || entry.offset > lexiconWords.size() ||
+                entry.length > lexiconWords.size() - entry.offset || entry.shard >= shardCount) {
+                return false;
+            }
+            for (int32_t handle : entry.term.lists) {
+                if (handle >= static_cast<int64_t>(shards[entry.shard].lists.size())) return false;
+            }
+            if (entry.term.impacts >= static_cast<int64_t>(shards[entry.shard].impacts.size())) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Call a function for every posting list in the index.
+     * @param visit Called with the category, the word and its posting list.
+     */
+    template <typename Visit>
+    void forEachList(Visit &&visit) const {
+        for (const Shard &shard : shards) {
+            for (const auto &entry : shard.terms) {
+                for (int category = 0; category < CATEGORY_COUNT; ++category) {
+                    if (entry.second.lists[category] >= 0) {
+                        visit(category, entry.first, shard.lists[entry.second.lists[category]]);
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * @brief Movie IDs in ascending order of one attribute, built once per load.
+ *
+ * Sorting a result set then needs no comparisons between movies: a broad result
+ * set is marked in a bitmap and the permutation is walked once, a small one is sorted by
+ * the movies' positions in the permutation. Either way the first `limit` IDs are produced
+ * without ordering the rest.
+ */
+struct SortOrder {
+    std::vector<int> ids;  ///< Movie IDs in ascending order of the attribute; ties in ID order.
+    std::vector<int> rank; ///< rank[id] is the position of movie `id` in `ids`.
+
+    /**
+     * @brief Adds the movies from `firstNew` on to the order.
+     *
+     * @param keys The attribute of all movies of the snapshot, indexed by movie ID; movies
+     *             before `firstNew` are already ordered.
+     * @param firstNew ID of the first movie to add.
+     */
+    template<typename T>
+    void extend(const std::vector<T> &keys, size_t firstNew) {
+        auto less = [&](int a, int b) {
+            return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+        };
+        size_t oldSize = ids.size();
+        for (size_t id = firstNew; id < keys.size(); ++id) {
+            ids.push_back(static_cast<int>(id));
+        }
+        if (oldSize == ids.size()) return;
+        std::sort(ids.begin() + oldSize, ids.end(), less);
+        // Movies ordered before the first new one keep their positions, and so their ranks.
+        size_t firstMoved = std::upper_bound(ids.begin(), ids.begin() + oldSize, ids[oldSize], less) - ids.begin();
+        std::inplace_merge(ids.begin(), ids.begin() + oldSize, ids.end(), less);
+
+        rank.resize(ids.size());
+        for (size_t i = firstMoved; i < ids.size(); ++i) {
+            rank[ids[i]] = static_cast<int>(i);
+        }
+    }
+
+    /**
+     * @brief Orders a result set by the attribute.
+     *
+     * @param results Movie IDs to order.
+     * @param descending Whether the highest values come first.
+     * @param limit Maximum number of IDs to produce.
+     * @param out Receives the first `limit` IDs of `results` in order.
+     */
+    void select(const std::vector<int> &results, bool descending, size_t limit, std::vector<int> &out) const {
+        out.clear();
+        size_t count = std::min(limit, results.size());
+        if (count == 0) return;
+
+        if (results.size() * 16 < ids.size()) {
+            // Few results: sort their ranks, which are small contiguous integers.
+            std::vector<int> ranks;
+            ranks.reserve(results.size());
+            for (int id: results) ranks.push_back(descending ? -rank[id] : rank[id]);
+            std::partial_sort(ranks.begin(), ranks.begin() + count, ranks.end());
+            for (size_t i = 0; i < count; ++i) out.push_back(ids[descending ? -ranks[i] : ranks[i]]);
+            return;
+        }
+
+        // Many results: mark them and walk the permutation, stopping after `count` matches.
+        thread_local std::vector<uint64_t> marks;
+        marks.assign((ids.size() + 63) / 64, 0);
+        for (int id: results) marks[id >> 6] |= uint64_t(1) << (id & 63);
+        out.reserve(count);
+        for (size_t i = 0; i < ids.size() && out.size() < count; ++i) {
+            int id = ids[descending ? ids.size() - 1 - i : i];
+            if (marks[id >> 6] >> (id & 63) & 1) out.push_back(id);
+        }
+    }
+};
+
+/**
+ * @brief An immutable, fully built copy of the movie data.
+ *
+ * `loadMovies` builds a new snapshot off to the side and publishes it with a
+ * single atomic store. Request handlers take a reference-counted handle to the
+ * current snapshot, so a reload never changes the data under a running query
+ * and an old snapshot is freed once its last reader is done.
+ */
+#include <atomic>
+#include <memory>
+#include <filesystem>
+
+struct MovieSnapshot {
+    MovieStore movies;
+    std::unordered_set<std::string> genres, languages;
+    std::set<int> years;
+    std::set<float> ratings;
+    InvertedIndex index{8};
+    SortOrder byRating, byYear;                        ///< Precomputed orders for sorted results.
+
+    uintmax_t sourceSize = 0;                          ///< Size of the CSV file the snapshot was built from.
+    std::filesystem::file_time_type sourceModified{};  ///< Modification time of that file.
+    uint64_t sourceHash = 0;                           ///< FNV-1a hash of the first `sourceSize` bytes.
+    bool sourceEndsWithNewline = false;                ///< Whether the parsed bytes end on a complete line.
+    uint64_t generation = 0;                           ///< Number of the publish; distinguishes snapshots for caches.
+};
+
+std::atomic<std::shared_ptr<const MovieSnapshot>> currentSnapshot{std::make_shared<const MovieSnapshot>()};
+
+/**
+ * @brief Get a handle to the most recently published snapshot.
+ * @return A shared pointer that keeps the snapshot alive while it is held.
+ */
+std::shared_ptr<const MovieSnapshot> acquireSnapshot() {
+    return currentSnapshot.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Make a finished snapshot the current one; running queries keep their old one.
+ * @param snapshot The snapshot to publish; it gets the next generation number.
+ */
+void publishSnapshot(std::shared_ptr<MovieSnapshot> snapshot) {
+    static std::atomic<uint64_t> lastGeneration{0};
+    snapshot->generation = ++lastGeneration;
+    currentSnapshot.store(std::move(snapshot), std::memory_order_release);
+}
+
+/**
+ * @brief A work-stealing task scheduler shared by request handling and data loading.
+ *
+ * Every worker owns a deque of tasks. Tasks submitted by a worker go to the bottom of its own
+ * deque and are popped from there, newest first; tasks submitted by other threads (I/O threads,
+ * the loader) go round-robin into the workers' inboxes. A worker that runs out of work steals
+ * from the top of the other deques and inboxes, so no single queue or lock is shared by all
+ * submitters. Idle workers spin briefly and then sleep on a counter that is only notified
+ * while someone is actually sleeping.
+ */
+#include <functional>
+#include <deque>
+#include <atomic>
+
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+private:
+    /**
+     * @brief A fixed-capacity Chase-Lev deque.
+     *
+     * Only the owning worker pushes and pops at the bottom; any thread may steal from the top.
+     */
+    class WorkDeque {
+        static constexpr int64_t CAPACITY = 1024;
+        std::atomic<int64_t> top{0}, bottom{0};
+        std::atomic<Task *> slots[CAPACITY] = {};
+
+    public:
+        /**
+         * @brief Push a task at the bottom; owner only.
+         * @return False if the deque is full.
+         */
+        bool push(Task *task) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            if (b - top.load(std::memory_order_acquire) >= CAPACITY) return false;
+            slots[b % CAPACITY].store(task, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release); // Publishes the task to thieves.
+            return true;
+        }
+
+        /**
+         * @brief Pop the newest task; owner only.
+         * @return The task, or nullptr if the deque is empty.
+         */
+        Task *pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task *task = slots[b % CAPACITY].load(std::memory_order_relaxed);
+            if (t == b) {
+                // Last task: race the thieves for it.
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    task = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        /**
+         * @brief Take the oldest task; any thread.
+         * @return The task, or nullptr if the deque was empty or another thread won it.
+         */
+        Task *steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) return nullptr;
+            Task *task = slots[t % CAPACITY].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return task;
+        }
+    };
+
+    /**
+     * @brief The queues and thread of one worker.
+     */
+    struct Worker {
+        WorkDeque deque; ///< Tasks submitted by the worker itself.
+        std::mutex inboxMutex; ///< Guards `inbox`.
+        std::deque<Task *> inbox; ///< Tasks submitted by other threads, oldest first.
+        std::atomic<size_t> inboxSize{0}; ///< Size of `inbox`, so empty inboxes are skipped without locking.
+        std::thread thread; ///< The worker thread.
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers; ///< All workers; their addresses never change.
+    std::atomic<size_t> nextInbox{0}; ///< Round-robin position for tasks from other threads.
+    std::atomic<uint32_t> wakeups{0}; ///< Bumped on every submission; sleeping workers wait for it to change.
+    std::atomic<size_t> sleepers{0}; ///< Number of workers about to sleep or sleeping.
+    std::atomic<bool> stop{false}; ///< Set when the pool is destroyed.
+
+    inline static thread_local ThreadPool *currentPool = nullptr; ///< The pool the calling thread works for.
+    inline static thread_local size_t currentWorker = 0; ///< The calling thread's index in `currentPool`.
+
+    /**
+     * @brief Take the oldest task of a worker's inbox.
+     */
+    static Task *takeInbox(Worker &worker) {
+        if (worker.inboxSize.load(std::memory_order_relaxed) == 0) return nullptr;
+        std::lock_guard<std::mutex> lock(worker.inboxMutex);
+        if (worker.inbox.empty()) return nullptr;
+        Task *task = worker.inbox.front();
+        worker.inbox.pop_front();
+        worker.inboxSize.store(worker.inbox.size(), std::memory_order_relaxed);
+        return task;
+    }
+
+    /**
+     * @brief Find the next task for a worker: its own deque, its inbox, then the other workers'.
+     */
+    Task *findTask(size_t self) {
+        Worker &own = *workers[self];
+        if (Task *task = own.deque.pop()) return task;
+        if (Task *task = takeInbox(own)) return task;
+        for (size_t k = 1; k < workers.size(); ++k) {
+            Worker &victim = *workers[(self + k) % workers.size()];
+            if (Task *task = victim.deque.steal()) return task;
+            if (Task *task = takeInbox(victim)) return task;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Runs tasks until the pool is destroyed and no task is left.
+     */
+    void workerLoop(size_t self) {
+        currentPool = this;
+        currentWorker = self;
+        while (true) {
+            Task *task = findTask(self);
+            for (int spin = 0; !task && spin < 32; ++spin) {
+                std::this_thread::yield();
+                task = findTask(self);
+            }
+            if (!task) {
+                // Announce the sleep before the last look, so a concurrent submission either
+                // is seen by that look or changes `wakeups` and notifies.
+                sleepers.fetch_add(1);
+                uint32_t seen = wakeups.load();
+                task = findTask(self);
+                if (!task) {
+                    if (stop.load()) {
+                        sleepers.fetch_sub(1);
+                        return;
+                    }
+                    wakeups.wait(seen);
+                }
+                sleepers.fetch_sub(1);
+                if (!task) continue;
+            }
+            (*task)();
+            delete task;
+        }
+    }
+
+public:
+    /**
+     * @brief Constructs the pool and starts its workers.
+     *
+     * @param numThreads The number of worker threads to create; with none, tasks run on the submitting thread.
+     */
+    ThreadPool(size_t numThreads) {
+        for (size_t i = 0; i < numThreads; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < numThreads; ++i) {
+            workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+        }
+    }
+
+    /**
+     * @brief Get the number of worker threads.
+     */
+    size_t size() const {
+        return workers.size();
+    }
+
+    /**
+     * @brief Adds a new task to the pool.
+     *
+     * @param task The work to run on one of the worker threads.
+     */
+    void enqueue(Task task) {
+        if (workers.empty()) {
+            task();
+            return;
+        }
+        Task *item = new Task(std::move(task));
+        bool onWorker = currentPool == this;
+        if (!onWorker || !workers[currentWorker]->deque.push(item)) {
+            Worker &worker = *workers[onWorker ? currentWorker : nextInbox.fetch_add(1, std::memory_order_relaxed) %
+                                                                 workers.size()];
+            std::lock_guard<std::mutex> lock(worker.inboxMutex);
+            worker.inbox.push_back(item);
+            worker.inboxSize.store(worker.inbox.size(), std::memory_order_relaxed);
+        }
+        wakeups.fetch_add(1);
+        if (sleepers.load() > 0) wakeups.notify_one();
+    }
+
+    /**
+     * @brief Runs `body(i)` for every i in [0, count) and waits until all calls have returned.
+     *
+     * The calling thread takes part, so the pool's workers plus the caller share the work;
+     * indexes are handed out one at a time to whichever thread is free.
+     *
+     * @param count The number of indexes.
+     * @param body Called once per index, possibly concurrently.
+     */
+    template <typename Body>
+    void parallelFor(size_t count, Body &&body) {
+        struct State {
+            std::atomic<size_t> next{0}; ///< Next unclaimed index.
+            std::atomic<size_t> done{0}; ///< Number of finished calls.
+        };
+        // Helpers that start late only touch the shared state; `body` is used for claimed indexes only.
+        auto state = std::make_shared<State>();
+        auto work = [state, count, &body]() {
+            for (size_t i; (i = state->next.fetch_add(1)) < count;) {
+                body(i);
+                if (state->done.fetch_add(1) + 1 == count) state->done.notify_all();
+            }
+        };
+        for (size_t i = 1; i < std::min(count, workers.size() + 1); ++i) {
+            enqueue(work);
+        }
+        work();
+        for (size_t done = state->done.load(); done < count; done = state->done.load()) {
+            state->done.wait(done);
+        }
+    }
+
+    /**
+     * @brief Destroys the pool once all submitted tasks have run.
+     */
+    ~ThreadPool() {
+        stop.store(true);
+        wakeups.fetch_add(1);
+        wakeups.notify_all();
+        for (auto &worker: workers) {
+            worker->thread.join();
+        }
+    }
+};
+
+/**
+ * @brief The pool shared by request handling and data loading, with one worker per core.
+ */
+ThreadPool &sharedPool() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+/**
+ * @brief Per-thread counters and latency histograms for the hot paths.
+ *
+ * Every thread that records gets its own block of counters, registered once under a mutex
+ * and kept for the lifetime of the process. A thread only ever writes its own block, so a
+ * sample is a pair of relaxed loads and stores without any locked instruction; a scrape reads
+ * all blocks with relaxed loads and adds them up, which can miss samples that are in flight
+ * but never blocks a recording thread.
+ *
+ * Histograms are log-linear in the style of HDR histograms: each power of two of nanoseconds
+ * from 1 us to 69 s is split into two buckets, which bounds the relative error of a quantile
+ * read from the buckets by 50%, with overflow counted in the last bucket.
+ */
+#include <bit>
+class Metrics {
+public:
+    /**
+     * @brief The timed stages: request handling first, then the phases of a data load.
+     */
+    enum Stage {
+        Parse,      ///< Parsing a request from the receive buffer.
+        Queue,      ///< Waiting for a worker after the request was complete.
+        Facets,     ///< Looking up the posting lists of the genre, year and language filters.
+        Keywords,   ///< Looking up the posting lists of the keywords.
+        Intersect,  ///< Intersecting the filters and keywords.
+        Sort,       ///< Selecting the requested page in sort order.
+        Render,     ///< Rendering a response body, over all of its pieces.
+        Send,       ///< Writing a response, from its first byte to its last.
+        LoadScan,   ///< Data load: pre-scan for chunk boundaries.
+        LoadParse,  ///< Data load: CSV parsing (slowest chunk).
+        LoadIndex,  ///< Data load: tokenizing into partial indexes (slowest chunk).
+        LoadMerge,  ///< Data load: merging thread results and index shards.
+        STAGE_COUNT
+    };
+
+    /**
+     * @brief The counted events.
+     */
+    enum Counter {
+        Requests,     ///< Requests handled by a worker.
+        CacheHits,    ///< Form searches answered from the result cache.
+        CacheMisses,  ///< Form searches that ran the intersection.
+        BytesSent,    ///< Response bytes written to sockets.
+        COUNTER_COUNT
+    };
+
+    static constexpr int FIRST_LOAD_STAGE = LoadScan;
+    static constexpr int MIN_EXPONENT = 10; ///< The first bucket holds everything below 2^10 ns.
+    static constexpr int MAX_EXPONENT = 35; ///< Octaves up to 2^36 ns; longer samples overflow.
+    static constexpr int BUCKET_COUNT = (MAX_EXPONENT - MIN_EXPONENT + 1) * 2 + 2;
+
+    /**
+     * @brief The sum over all threads of every counter and histogram.
+     */
+    struct Totals {
+        uint64_t buckets[STAGE_COUNT][BUCKET_COUNT] = {}; ///< Samples per bucket, not cumulative.
+        uint64_t sums[STAGE_COUNT] = {};                  ///< Sum of the samples in nanoseconds.
+        uint64_t counters[COUNTER_COUNT] = {};
+    };
+
+    /**
+     * @brief Name of a stage as used in the exposition labels.
+     */
+    static const char *stageName(int stage) {
+        static const char *names[STAGE_COUNT] = {"parse", "queue", "facets", "keywords", "intersect", "sort",
+                                                 "render", "send", "scan", "parse", "index", "merge"};
+        return names[stage];
+    }
+
+    /**
+     * @brief Exclusive upper bound of a bucket in nanoseconds; the last bucket is unbounded.
+     */
+    static uint64_t bucketBound(int bucket) {
+        if (bucket == 0) return uint64_t{1} << MIN_EXPONENT;
+        int exponent = MIN_EXPONENT + (bucket - 1) / 2;
+        return (bucket - 1) % 2 ? uint64_t{2} << exponent : uint64_t{3} << (exponent - 1);
+    }
+
+    /**
+     * @brief Record the duration of a stage on the calling thread.
+     */
+    static void record(Stage stage, std::chrono::steady_clock::duration elapsed) {
+        uint64_t nanoseconds = static_cast<uint64_t>(
+            std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        Block &block = local();
+        bump(block.buckets[stage][bucketOf(nanoseconds)], 1);
+        bump(block.sums[stage], nanoseconds);
+    }
+
+    /**
+     * @brief Add to a counter on the calling thread.
+     */
+    static void add(Counter counter, uint64_t amount = 1) {
+        bump(local().counters[counter], amount);
+    }
+
+    /**
+     * @brief Sum the blocks of all threads.
+     */
+    static Totals collect() {
+        Totals totals;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const Block &block: registry) {
+            for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+                for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+                    totals.buckets[stage][bucket] += block.buckets[stage][bucket].load(std::memory_order_relaxed);
+                }
+                totals.sums[stage] += block.sums[stage].load(std::memory_order_relaxed);
+            }
+            for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+                totals.counters[counter] += block.counters[counter].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+    /**
+     * @brief Times a stage from construction to destruction.
+     */
+    class Timer {
+        Stage stage;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    public:
+        explicit Timer(Stage stage) : stage(stage) {}
+        ~Timer() { record(stage, std::chrono::steady_clock::now() - start); }
+    };
+
+private:
+    /**
+     * @brief The counters written by one thread.
+     */
+    struct Block {
+        std::atomic<uint64_t> buckets[STAGE_COUNT][BUCKET_COUNT] = {};
+        std::atomic<uint64_t> sums[STAGE_COUNT] = {};
+        std::atomic<uint64_t> counters[COUNTER_COUNT] = {};
+    };
+
+    inline static std::mutex registryMutex;
+    inline static std::deque<Block> registry; ///< A deque keeps the blocks in place as threads register.
+
+    static Block &local() {
+        thread_local Block *block = [] {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            return &registry.emplace_back();
+        }();
+        return *block;
+    }
+
+    /// Only the owning thread writes a block, so a plain read-modify-write cannot lose updates.
+    static void bump(std::atomic<uint64_t> &value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static int bucketOf(uint64_t nanoseconds) {
+        if (nanoseconds < (uint64_t{1} << MIN_EXPONENT)) return 0;
+        int exponent = std::bit_width(nanoseconds) - 1;
+        if (exponent > MAX_EXPONENT) return BUCKET_COUNT - 1;
+        int upperHalf = static_cast<int>((nanoseconds >> (exponent - 1)) & 1);
+        return (exponent - MIN_EXPONENT) * 2 + upperHalf + 1;
+    }
+};
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * Uses `CreateFileMapping` on Windows and `mmap` on POSIX systems. An empty
+ * file is reported as open with a size of zero.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <string_view>
+#include <charconv>
+#include <cstring>
+
+class MappedFile {
+public:
+    /**
+     * @brief Map a file into memory.
+     * @param filePath Path to the file; check `isOpen` for success.
+     */
+    explicit MappedFile(const std::string &filePath) {
+#ifdef _WIN32
+        file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) return;
+        length = static_cast<size_t>(fileSize.QuadPart);
+        opened = true;
+        if (length == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            bytes = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        fd = open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info{};
+        if (fstat(fd, &info) != 0) return;
+        length = static_cast<size_t>(info.st_size);
+        opened = true;
+        if (length == 0) return;
+        void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            bytes = static_cast<const char *>(address);
+            madvise(address, length, MADV_SEQUENTIAL);
+        }
+#endif
+        if (bytes == nullptr) {
+            opened = false;
+            length = 0;
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (bytes) munmap(const_cast<char *>(bytes), length);
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool isOpen() const { return opened; }
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+/**
+ * @brief A single CSV field pointing into the parsed buffer.
+ */
+struct CsvField {
+    std::string_view text; ///< Field contents without the surrounding quotes.
+    bool escaped = false;  ///< True if `text` still contains doubled ("") quotes.
+
+    /**
+     * @brief Get the field value, turning doubled quotes into single ones.
+     * @param buffer Holds the unescaped copy if the field needs one.
+     * @return The unescaped field value; a view into the parsed buffer or into `buffer`.
+     */
+    std::string_view view(std::string &buffer) const {
+        if (!escaped) return text;
+        buffer.clear();
+        for (size_t i = 0; i < text.size(); ++i) {
+            buffer += text[i];
+            if (text[i] == '"') ++i; // Skip the second quote of the pair.
+        }
+        return buffer;
+    }
+};
+
+/**
+ * @brief Splits CSV records into fields without copying them.
+ *
+ * Records end at a newline outside quotes, so quoted fields may contain
+ * commas and newlines. A trailing '\r' is dropped from unquoted fields.
+ */
+class CsvReader {
+public:
+    CsvReader(const char *begin, const char *end) : pos(begin), end(end) {}
+
+    /**
+     * @brief Read the next record.
+     * @param fields Receives one view per field.
+     * @return False when there are no more records.
+     */
+    bool next(std::vector<CsvField> &fields) {
+        fields.clear();
+        if (pos >= end) return false;
+        while (true) {
+            CsvField field;
+            if (pos < end && *pos == '"') {
+                const char *start = ++pos;
+                while (pos < end) {
+                    if (*pos == '"') {
+                        if (pos + 1 < end && pos[1] == '"') {
+                            field.escaped = true;
+                            pos += 2;
+                            continue;
+                        }
+                        break;
+                    }
+                    ++pos;
+                }
+                field.text = std::string_view(start, pos - start);
+                if (pos < end) ++pos; // Closing quote.
+                while (pos < end && *pos != ',' && *pos != '\n') ++pos; // Ignore junk after the quote.
+            } else {
+                const char *start = pos;
+                while (pos < end && *pos != ',' && *pos != '\n') ++pos;
+                const char *stop = (pos > start && pos[-1] == '\r') ? pos - 1 : pos;
+                field.text = std::string_view(start, stop - start);
+            }
+            fields.push_back(field);
+            if (pos >= end) return true;
+            if (*pos++ == '\n') return true;
+        }
+    }
+
+    /**
+     * @brief Get the position of the next unread byte.
+     * @return A pointer into the parsed buffer.
+     */
+    const char *position() const {
+        return pos;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+/**
+ * @brief Bit masks of the quote and newline characters in a 64-byte block.
+ */
+struct CsvBlockMasks {
+    uint64_t quotes;   ///< Bit i is set if byte i is '"'.
+    uint64_t newlines; ///< Bit i is set if byte i is '\n'.
+};
+
+/**
+ * @brief Classify 64 bytes at once with SIMD compares (scalar without SSE2).
+ * @param p The first of 64 readable bytes.
+ * @return The quote and newline masks of the block.
+ */
+inline CsvBlockMasks scanCsvBlock(const char *p) {
+    CsvBlockMasks masks{0, 0};
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"'), newline = _mm256_set1_epi8('\n');
+    for (int i = 0; i < 64; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        masks.quotes |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, quote)))} << i;
+        masks.newlines |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)))} << i;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i quote = _mm_set1_epi8('"'), newline = _mm_set1_epi8('\n');
+    for (int i = 0; i < 64; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        masks.quotes |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))} << i;
+        masks.newlines |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))} << i;
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        masks.quotes |= uint64_t{p[i] == '"'} << i;
+        masks.newlines |= uint64_t{p[i] == '\n'} << i;
+    }
+#endif
+    return masks;
+}
+
+/**
+ * @brief Result of pre-scanning one raw chunk of the CSV file.
+ *
+ * The quote state at the start of a chunk is only known once the chunks
+ * before it are scanned, so the first record boundary is recorded for both
+ * possible start states.
+ */
+struct CsvChunkScan {
+    size_t firstIfOutside = std::string::npos; ///< First unquoted newline if the chunk starts outside quotes.
+    size_t firstIfInside = std::string::npos;  ///< First unquoted newline if the chunk starts inside quotes.
+    bool oddQuotes = false;                    ///< Whether the chunk contains an odd number of quotes.
+};
+
+/**
+ * @brief Pre-scan a byte range for quotes and newlines, 64 bytes at a time.
+ * @param data The CSV contents.
+ * @param from Offset of the first byte to scan.
+ * @param to Offset one past the last byte to scan.
+ * @return The candidate record boundaries and quote parity of the range.
+ */
+CsvChunkScan scanCsvChunk(const char *data, size_t from, size_t to) {
+    CsvChunkScan scan;
+    uint64_t carry = 0; // All ones while an odd number of quotes has been seen.
+    for (size_t pos = from; pos < to; pos += 64) {
+        size_t length = std::min<size_t>(64, to - pos);
+        CsvBlockMasks masks;
+        if (length == 64) {
+            masks = scanCsvBlock(data + pos);
+        } else {
+            char tail[64] = {};
+            std::memcpy(tail, data + pos, length);
+            masks = scanCsvBlock(tail);
+            uint64_t valid = (uint64_t{1} << length) - 1;
+            masks.quotes &= valid;
+            masks.newlines &= valid;
+        }
+
+        // Prefix XOR turns the quote mask into an "inside quotes" mask.
+        uint64_t inside = masks.quotes;
+        inside ^= inside << 1;
+        inside ^= inside << 2;
+        inside ^= inside << 4;
+        inside ^= inside << 8;
+        inside ^= inside << 16;
+        inside ^= inside << 32;
+        inside ^= carry;
+
+        if (scan.firstIfOutside == std::string::npos && (masks.newlines & ~inside)) {
+            scan.firstIfOutside = pos + std::countr_zero(masks.newlines & ~inside);
+        }
+        if (scan.firstIfInside == std::string::npos && (masks.newlines & inside)) {
+            scan.firstIfInside = pos + std::countr_zero(masks.newlines & inside);
+        }
+        carry = (inside >> 63) ? ~uint64_t{0} : 0;
+    }
+    scan.oddQuotes = carry != 0;
+    return scan;
+}
+
+/**
+ * @brief Split a byte range of the CSV file into chunks that start on record boundaries.
+ *
+ * Every chunk is pre-scanned in parallel; the quote parity of the chunks before it then
+ * decides which of its candidate boundaries is real. A record boundary is the byte after
+ * a newline that is not inside a quoted field, so rows are never split, dropped or parsed
+ * twice, even when fields contain newlines.
+ *
+ * @param data The CSV contents.
+ * @param begin Offset of the first byte; must be a record boundary.
+ * @param end Offset one past the last byte.
+ * @param numChunks Number of chunks to produce.
+ * @param pool The pool that scans the chunks.
+ * @return `numChunks + 1` offsets; chunk i is [result[i], result[i + 1]).
+ */
+std::vector<size_t> findRecordBoundaries(const char *data, size_t begin, size_t end, size_t numChunks,
+                                         ThreadPool &pool) {
+    size_t chunkSize = (end - begin) / numChunks;
+    std::vector<CsvChunkScan> scans(numChunks);
+    pool.parallelFor(numChunks, [&](size_t i) {
+        size_t from = begin + i * chunkSize;
+        size_t to = i == 0 ? std::min(end, begin + chunkSize) : (i == numChunks - 1) ? end : from + chunkSize;
+        scans[i] = scanCsvChunk(data, from, to);
+    });
+
+    std::vector<size_t> boundaries(numChunks + 1, std::string::npos);
+    boundaries[0] = begin;
+    boundaries[numChunks] = end;
+    bool inQuotes = scans[0].oddQuotes;
+    for (size_t i = 1; i < numChunks; ++i) {
+        size_t newline = inQuotes ? scans[i].firstIfInside : scans[i].firstIfOutside;
+        if (newline != std::string::npos) boundaries[i] = newline + 1;
+        inQuotes ^= scans[i].oddQuotes;
+    }
+    // A chunk without a boundary of its own starts where the next one does.
+    for (size_t i = numChunks - 1; i > 0; --i) {
+        if (boundaries[i] == std::string::npos) boundaries[i] = boundaries[i + 1];
+    }
+    return boundaries;
+}
+
+/**
+ * @brief Wall-clock durations of the phases of `ingestMovies`, in seconds.
+ *
+ * Parse and index times are those of the slowest thread, since the phase
+ * ends only when every thread is done.
+ */
+struct LoadStats {
+    double scanSeconds = 0;  ///< Quote-aware pre-scan for chunk boundaries.
+    double parseSeconds = 0; ///< CSV parsing into movies.
+    double indexSeconds = 0; ///< Tokenizing movies into thread-local partial indexes.
+    double mergeSeconds = 0; ///< Combining thread results and merging shards.
+    size_t movies = 0;       ///< Number of movies added.
+};
+
+/**
+ * @brief Adds the genres, languages, years and ratings of movies to the facet sets of a snapshot.
+ *
+ * @param snapshot The snapshot whose movies are collected.
+ * @param firstMovie ID of the first movie whose year and rating are added; the genre and
+ *                   language tables are always added whole.
+ */
+void collectFacets(MovieSnapshot &snapshot, size_t firstMovie) {
+    const std::vector<std::string> &genreNames = snapshot.movies.genreTable();
+    const std::vector<std::string> &languageNames = snapshot.movies.languageTable();
+    snapshot.genres.insert(genreNames.begin(), genreNames.end());
+    snapshot.languages.insert(languageNames.begin(), languageNames.end());
+    for (size_t id = firstMovie; id < snapshot.movies.size(); ++id) {
+        snapshot.years.insert(snapshot.movies.year(static_cast<int>(id)));
+        snapshot.ratings.insert(snapshot.movies.rating(static_cast<int>(id)));
+    }
+}
+
+/**
+ * @brief Parses and indexes a byte range of the movie CSV file in parallel.
+ *
+ * This function divides the range into chunks on record boundaries, processes the chunks as
+ * tasks on a thread pool, and appends the results to the movies, genres, languages, years, and
+ * ratings of a snapshot. `begin` must be the start of a record. Every chunk also gets a partial
+ * index of its own movies; the partial indexes are then merged into the snapshot's index with
+ * one task per shard, and the merged posting lists are finalized.
+ *
+ * @param data The mapped contents of the CSV file.
+ * @param begin Offset of the first byte to parse.
+ * @param end Offset one past the last byte to parse.
+ * @param numThreads Number of chunks to process in parallel.
+ * @param snapshot The snapshot to append the parsed movies to.
+ * @param stats Receives the duration of each phase, if not null.
+ * @param pool The pool that runs the tasks, together with the calling thread.
+ */
+void ingestMovies(const char *data, size_t begin, size_t end, size_t numThreads, MovieSnapshot &snapshot,
+                  LoadStats *stats = nullptr, ThreadPool &pool = sharedPool()) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::duration d) { return std::chrono::duration<double>(d).count(); };
+    Clock::time_point scanStart = Clock::now();
+
+    // Split the range into one chunk of whole records per parallel task.
+    std::vector<size_t> boundaries = findRecordBoundaries(data, begin, end, numThreads, pool);
+    Clock::time_point scanEnd = Clock::now();
+
+    // Temporary structures to store thread-specific results.
+    std::vector<MovieStore> threadMovies(numThreads);
+    std::vector<InvertedIndex::PartialIndex> threadIndexes(numThreads);
+    std::vector<Clock::duration> threadParseTimes(numThreads), threadIndexTimes(numThreads);
+
+    // Lambda function for processing a chunk of the file.
+    auto processChunk = [&](size_t threadId, size_t startPos, size_t endPos) {
+        Clock::time_point parseStart = Clock::now();
+        CsvReader reader(data + startPos, data + endPos);
+        std::vector<CsvField> fields;
+        Movie movie;                                   // Reused for every record of the chunk.
+        std::string title, overview, language, poster; // Unescaped copies of quoted fields.
+        threadMovies[threadId].reserveText(endPos - startPos);
+
+        // Read and process each record of the chunk.
+        while (reader.next(fields)) {
+            if (fields.size() < 9) continue; // Skip malformed lines.
+            movie.genres.clear();
+
+            // Populate the movie fields.
+            std::string_view date = fields[0].text.substr(0, 4);
+            movie.year = 0;
+            if (!date.empty() && std::from_chars(date.data(), date.data() + date.size(), movie.year).ec != std::errc()) {
+                continue; // Skip malformed lines.
+            }
+            std::string_view vote = fields[5].text;
+            movie.rating = 0.0f;
+            if (!vote.empty() && std::from_chars(vote.data(), vote.data() + vote.size(), movie.rating).ec != std::errc()) {
+                continue;
+            }
+            movie.title = fields[1].view(title);
+            movie.overview = fields[2].view(overview);
+            movie.language = fields[6].view(language);
+            movie.posterUrl = fields[8].view(poster);
+
+            // Parse and clean genres.
+            std::string_view genreList = fields[7].text;
+            while (!genreList.empty()) {
+                size_t comma = genreList.find(',');
+                std::string_view genre = genreList.substr(0, comma);
+                genreList = comma == std::string_view::npos ? std::string_view() : genreList.substr(comma + 1);
+
+                size_t first = genre.find_first_not_of(" \"");
+                if (first == std::string_view::npos) continue;
+                genre = genre.substr(first, genre.find_last_not_of(" \"") - first + 1);
+                movie.genres.push_back(genre);
+            }
+
+            // Validate and add the movie to thread-specific results.
+            if (!movie.title.empty() && !movie.overview.empty() && !movie.genres.empty() &&
+                movie.year != 0 && movie.rating > 0.0f) {
+                threadMovies[threadId].add(movie);
+            }
+        }
+        Clock::time_point indexStart = Clock::now();
+
+        // Index the chunk's movies into the thread's partial index.
+        for (size_t i = 0; i < threadMovies[threadId].size(); ++i) {
+            snapshot.index.addToPartial(threadIndexes[threadId], threadMovies[threadId], static_cast<int>(i));
+        }
+        threadParseTimes[threadId] = indexStart - parseStart;
+        threadIndexTimes[threadId] = Clock::now() - indexStart;
+    };
+
+    // Process the chunks on the pool and wait for all of them.
+    pool.parallelFor(numThreads, [&](size_t i) { processChunk(i, boundaries[i], boundaries[i + 1]); });
+    Clock::time_point mergeStart = Clock::now();
+
+    // Merge results from all threads into the snapshot.
+    size_t firstMovie = snapshot.movies.size();
+    std::vector<int> firstIds(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+        firstIds[i] = static_cast<int>(snapshot.movies.size());
+        snapshot.movies.append(threadMovies[i]);
+    }
+    collectFacets(snapshot, firstMovie);
+
+    // Merge the partial indexes with one task per shard, once the text lengths for BM25 are known.
+    snapshot.index.mergeTextLengths(threadIndexes, firstIds);
+    pool.parallelFor(snapshot.index.getShardCount(), [&](size_t shard) {
+        snapshot.index.mergeShard(shard, threadIndexes, firstIds, snapshot.movies.size());
+    });
+    snapshot.index.extendLexicon(threadIndexes);
+
+    // Add the new movies to the precomputed sort orders.
+    snapshot.byRating.extend(snapshot.movies.ratingColumn(), firstMovie);
+    snapshot.byYear.extend(snapshot.movies.yearColumn(), firstMovie);
+
+    Clock::duration parseTime = *std::max_element(threadParseTimes.begin(), threadParseTimes.end());
+    Clock::duration indexTime = *std::max_element(threadIndexTimes.begin(), threadIndexTimes.end());
+    Clock::duration mergeTime = Clock::now() - mergeStart;
+    Metrics::record(Metrics::LoadScan, scanEnd - scanStart);
+    Metrics::record(Metrics::LoadParse, parseTime);
+    Metrics::record(Metrics::LoadIndex, indexTime);
+    Metrics::record(Metrics::LoadMerge, mergeTime);
+    if (stats) {
+        stats->scanSeconds = seconds(scanEnd - scanStart);
+        stats->parseSeconds = seconds(parseTime);
+        stats->indexSeconds = seconds(indexTime);
+        stats->mergeSeconds = seconds(mergeTime);
+        stats->movies = snapshot.movies.size() - firstMovie;
+    }
+}
+
+/**
+ * @brief Computes the FNV-1a hash of a byte range.
+ *
+ * @param data The bytes to hash.
+ * @param length Number of bytes to hash.
+ * @param hash The hash of the bytes before `data`, to continue hashing a longer range.
+ * @return The hash value.
+ */
+uint64_t hashBytes(const char *data, size_t length, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Records the size, modification time, and content hash of the source file in a snapshot.
+ *
+ * @param file The mapped source CSV file.
+ * @param modified Modification time of the file when it was mapped.
+ * @param snapshot The snapshot to update.
+ * @param hashedSize The number of leading bytes already hashed, e.g. the part of the file that was only appended to.
+ * @param prefixHash The hash of those bytes.
+ */
+void stampSource(const MappedFile &file, std::filesystem::file_time_type modified, MovieSnapshot &snapshot,
+                 size_t hashedSize = 0, uint64_t prefixHash = hashBytes(nullptr, 0)) {
+    snapshot.sourceSize = file.size();
+    snapshot.sourceModified = modified;
+    snapshot.sourceHash = hashBytes(file.data() + hashedSize, file.size() - hashedSize, prefixHash);
+    snapshot.sourceEndsWithNewline = file.size() > 0 && file.data()[file.size() - 1] == '\n';
+}
+
+/**
+ * @brief Computes a checksum of a byte range, eight bytes at a time.
+ *
+ * Meant for detecting corrupt snapshot files: each word is mixed in with a multiply and
+ * a shift, which is several times faster than the byte-wise `hashBytes`.
+ *
+ * @param data The bytes to check.
+ * @param length Number of bytes.
+ * @return The checksum.
+ */
+uint64_t checksumBytes(const char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ull ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 32;
+    }
+    return hash ^ hashBytes(data + i, length - i);
+}
+
+/**
+ * @brief Fixed-size header of a snapshot file, followed by the encoded snapshot.
+ *
+ * The source fields identify the CSV file the snapshot was built from; a snapshot is only
+ * used while the CSV still has that size and modification time. The checksum covers every
+ * byte after it, so a torn or corrupt file is rejected, and the byte order mark rejects a
+ * file written on a machine of the other endianness.
+ */
+struct SnapshotFileHeader {
+    static constexpr uint32_t VERSION = 3; ///< Bumped whenever the encoding changes.
+
+    char magic[8] = {'C', 'W', 'M', 'O', 'V', 'I', 'E', 'S'};
+    uint32_t version = VERSION;
+    uint32_t byteOrder = 0x01020304;
+    uint64_t checksum = 0;
+    uint64_t sourceSize = 0;            ///< Size of the CSV file.
+    int64_t sourceModified = 0;         ///< Modification time of the CSV file, in `file_time_type` ticks.
+    uint64_t sourceHash = 0;            ///< FNV-1a hash of the CSV file.
+    uint64_t sourceEndsWithNewline = 0;
+    uint64_t payloadSize = 0;           ///< Number of encoded bytes after the header.
+};
+
+/**
+ * @brief Get the path of the snapshot file kept next to a CSV file.
+ */
+std::string snapshotFilePath(const std::string &csvPath) {
+    return csvPath + ".snapshot";
+}
+
+/**
+ * @brief Writes a finished snapshot to a file, replacing the previous one atomically.
+ *
+ * The file is written under a temporary name and renamed into place, so a crash while
+ * writing never leaves a torn snapshot behind.
+ *
+ * @param snapshot The snapshot to save; it must not be modified concurrently.
+ * @param path The snapshot file path.
+ * @return True if the file was written.
+ */
+bool saveSnapshotFile(const MovieSnapshot &snapshot, const std::string &path) {
+    SnapshotFileHeader header;
+    SnapshotWriter writer;
+    writer.write(header); // Filled in once the payload is known.
+    snapshot.movies.save(writer);
+    snapshot.index.save(writer);
+    writer.write(snapshot.byRating.ids);
+    writer.write(snapshot.byRating.rank);
+    writer.write(snapshot.byYear.ids);
+    writer.write(snapshot.byYear.rank);
+
+    header.sourceSize = snapshot.sourceSize;
+    header.sourceModified = static_cast<int64_t>(snapshot.sourceModified.time_since_epoch().count());
+    header.sourceHash = snapshot.sourceHash;
+    header.sourceEndsWithNewline = snapshot.sourceEndsWithNewline;
+    header.payloadSize = writer.bytes.size() - sizeof(header);
+    std::memcpy(writer.bytes.data(), &header, sizeof(header));
+    size_t covered = offsetof(SnapshotFileHeader, sourceSize);
+    header.checksum = checksumBytes(writer.bytes.data() + covered, writer.bytes.size() - covered);
+    std::memcpy(writer.bytes.data(), &header, sizeof(header));
+
+    std::string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(writer.bytes.data(), static_cast<std::streamsize>(writer.bytes.size()));
+    file.close();
+    std::error_code error;
+    if (file.fail()) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Loads the snapshot file of a CSV file, if it is still up to date.
+ *
+ * The file is mapped and its header, checksum and structure are validated before the
+ * columns and posting lists are copied out in bulk; nothing is parsed, tokenized or sorted.
+ *
+ * @param path The snapshot file path.
+ * @param sourceSize Current size of the CSV file.
+ * @param sourceModified Current modification time of the CSV file.
+ * @return The snapshot, or nullptr if the file is missing, stale, of another version or corrupt.
+ */
+std::shared_ptr<MovieSnapshot> loadSnapshotFile(const std::string &path, uintmax_t sourceSize,
+                                                std::filesystem::file_time_type sourceModified) {
+    MappedFile file(path);
+    SnapshotFileHeader header, expected;
+    if (!file.isOpen() || file.size() < sizeof(header)) return nullptr;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+        header.byteOrder != expected.byteOrder) {
+        return nullptr; // Written by another version of the server; rebuilt from the CSV.
+    }
+    if (header.sourceSize != sourceSize ||
+        header.sourceModified != static_cast<int64_t>(sourceModified.time_since_epoch().count())) {
+        return nullptr; // The CSV file changed since the snapshot was written.
+    }
+
+    size_t covered = offsetof(SnapshotFileHeader, sourceSize);
+    auto snapshot = std::make_shared<MovieSnapshot>();
+    SnapshotReader reader(file.data() + sizeof(header), file.size() - sizeof(header));
+    bool valid = header.payloadSize == file.size() - sizeof(header) &&
+                 checksumBytes(file.data() + covered, file.size() - covered) == header.checksum &&
+                 snapshot->movies.load(reader) && snapshot->index.load(reader) &&
+                 reader.read(snapshot->byRating.ids) && reader.read(snapshot->byRating.rank) &&
+                 reader.read(snapshot->byYear.ids) && reader.read(snapshot->byYear.rank) && reader.remaining() == 0;
+    size_t count = snapshot->movies.size();
+    for (const std::vector<int> *order : {&snapshot->byRating.ids, &snapshot->byRating.rank,
+                                          &snapshot->byYear.ids, &snapshot->byYear.rank}) {
+        valid = valid && order->size() == count &&
+                std::all_of(order->begin(), order->end(), [&](int id) { return id >= 0 && static_cast<size_t>(id) < count; });
+    }
+    if (!valid) {
+        std::cerr << "Error: Ignoring corrupt snapshot file!" << std::endl;
+        return nullptr;
+    }
+
+    collectFacets(*snapshot, 0);
+    snapshot->sourceSize = header.sourceSize;
+    snapshot->sourceModified = sourceModified;
+    snapshot->sourceHash = header.sourceHash;
+    snapshot->sourceEndsWithNewline = header.sourceEndsWithNewline != 0;
+    return snapshot;
+}
+
+/**
+ * @brief Loads movie data from a file, processes it in parallel, and publishes a new snapshot.
+ *
+ * If the snapshot file next to the CSV was written for its current size and modification
+ * time, the snapshot is loaded from there instead. Otherwise the function maps the file into
+ * memory and parses it into a new snapshot of movies, genres, languages, years, and ratings.
+ * It also builds an inverted index for efficient searching, publishes the snapshot, and saves
+ * it to the snapshot file for the next start.
+ *
+ * @param filePath Path to the input CSV file containing movie data.
+ * @param numThreads Number of threads to use for parallel processing.
+ */
+void loadMovies(const std::string &filePath, size_t numThreads) {
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(filePath, error);
+    uintmax_t fileSize = error ? 0 : std::filesystem::file_size(filePath, error);
+    if (error) {
+        std::cerr << "Error: Unable to open file!" << std::endl;
+        return;
+    }
+
+    // Start from the saved snapshot if the CSV has not changed since it was written.
+    std::string snapshotPath = snapshotFilePath(filePath);
+    if (std::shared_ptr<MovieSnapshot> saved = loadSnapshotFile(snapshotPath, fileSize, modified)) {
+        size_t count = saved->movies.size();
+        publishSnapshot(std::move(saved));
+        std::cout << "Loaded " << count << " movies from the snapshot file." << std::endl;
+        return;
+    }
+
+    MappedFile file(filePath);
+    if (!file.isOpen()) {
+        std::cerr << "Error: Unable to open file!" << std::endl;
+        return;
+    }
+
+    // Parse the movies and build the inverted index.
+    auto snapshot = std::make_shared<MovieSnapshot>();
+    ingestMovies(file.data(), 0, file.size(), numThreads, *snapshot);
+    stampSource(file, modified, *snapshot);
+
+    // Publish the finished snapshot; running queries keep their old one.
+    std::shared_ptr<const MovieSnapshot> published = snapshot;
+    publishSnapshot(std::move(snapshot));
+
+    std::cout << "Movies loaded and indexed successfully with " << numThreads << " threads." << std::endl;
+    if (!saveSnapshotFile(*published, snapshotPath)) {
+        std::cerr << "Error: Unable to write snapshot file!" << std::endl;
+    }
+}
+
+/**
+ * @brief Reloads movie data only if the source file has changed.
+ *
+ * The file's size and modification time are compared against the current snapshot first.
+ * If the file only grew and the previously loaded bytes still hash to the same value, only
+ * the appended byte range is parsed, and the new movies are added to a copy of the current
+ * snapshot. Any other change triggers a full `loadMovies`.
+ *
+ * Parsing, posting list encoding and the dictionary update only cost as much as the appended
+ * rows, but an append still copies the whole snapshot, recomputes every BM25 impact (the
+ * collection statistics changed) and rewrites the snapshot file after publishing.
+ *
+ * @param filePath Path to the input CSV file containing movie data.
+ * @param numThreads Number of threads to use for parallel processing.
+ */
+void reloadMovies(const std::string &filePath, size_t numThreads) {
+    std::error_code error;
+    uintmax_t fileSize = std::filesystem::file_size(filePath, error);
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(filePath, error);
+    if (error) {
+        std::cerr << "Error: Unable to open file!" << std::endl;
+        return;
+    }
+
+    // Size and modification time of a file whose content was found unchanged (only touched).
+    static uintmax_t verifiedSize = 0;
+    static std::filesystem::file_time_type verifiedModified{};
+
+    std::shared_ptr<const MovieSnapshot> current = acquireSnapshot();
+    if ((fileSize == current->sourceSize && modified == current->sourceModified) ||
+        (fileSize == verifiedSize && modified == verifiedModified)) {
+        return; // Nothing changed since the last check.
+    }
+
+    MappedFile file(filePath);
+    if (!file.isOpen()) {
+        std::cerr << "Error: Unable to open file!" << std::endl;
+        return;
+    }
+    size_t oldSize = static_cast<size_t>(current->sourceSize);
+    bool prefixUnchanged = oldSize > 0 && file.size() >= oldSize &&
+                           hashBytes(file.data(), oldSize) == current->sourceHash;
+
+    if (prefixUnchanged && file.size() == oldSize) {
+        // Only the modification time changed; remember it so the file is not hashed again.
+        verifiedSize = fileSize;
+        verifiedModified = modified;
+        return;
+    }
+    if (!prefixUnchanged || !current->sourceEndsWithNewline) {
+        loadMovies(filePath, numThreads);
+        return;
+    }
+
+    // Rows were only appended: parse the new byte range and index just those movies.
+    auto snapshot = std::make_shared<MovieSnapshot>(*current);
+    size_t firstNew = snapshot->movies.size();
+    ingestMovies(file.data(), oldSize, file.size(), numThreads, *snapshot);
+    stampSource(file, modified, *snapshot, oldSize, current->sourceHash);
+
+    size_t appended = snapshot->movies.size() - firstNew;
+    std::shared_ptr<const MovieSnapshot> published = snapshot;
+    publishSnapshot(std::move(snapshot));
+
+    std::cout << "Appended " << appended << " new movies to the index." << std::endl;
+    if (!saveSnapshotFile(*published, snapshotFilePath(filePath))) {
+        std::cerr << "Error: Unable to write snapshot file!" << std::endl;
+    }
+}
+
+/**
+ * @brief Bounded cache of search result sets, keyed by the normalized query.
+ *
+ * The cache is split into independently locked shards. Each shard evicts with the CLOCK
+ * algorithm: a hit sets an entry's reference bit, and the hand sweeping over the entries
+ * clears set bits and evicts the first entry found unreferenced, until the new entry fits
+ * into the shard's byte budget. Entries belong to one snapshot generation; the first
+ * access with a newer generation empties the shard, so a reload never serves stale IDs.
+ */
+class ResultCache {
+    struct Entry {
+        std::string key; ///< Normalized query.
+        std::shared_ptr<const std::vector<int>> ids; ///< Matching movie IDs in ascending order.
+        size_t cost; ///< Bytes charged against the shard budget.
+        bool referenced; ///< CLOCK reference bit; set by hits.
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        uint64_t generation = 0; ///< Snapshot generation of the cached entries.
+        std::vector<Entry> entries; ///< The CLOCK ring.
+        std::unordered_map<std::string, size_t> positions; ///< Index of each key in `entries`.
+        size_t hand = 0; ///< Next entry the CLOCK hand inspects.
+        size_t usedBytes = 0; ///< Sum of the entry costs.
+    };
+
+    std::vector<Shard> shards;
+    size_t shardBudget; ///< Byte budget of every shard.
+
+    Shard &shardFor(const std::string &key) {
+        return shards[std::hash<std::string>{}(key) % shards.size()];
+    }
+
+    /**
+     * @brief Drops all entries if they belong to an older generation. Requires the shard lock.
+     */
+    static void synchronize(Shard &shard, uint64_t generation) {
+        if (shard.generation != generation) {
+            shard.entries.clear();
+            shard.positions.clear();
+            shard.hand = 0;
+            shard.usedBytes = 0;
+            shard.generation = generation;
+        }
+    }
+
+    /**
+     * @brief Evicts the entry at `position` by moving the last entry into its slot.
+     */
+    static void evict(Shard &shard, size_t position) {
+        shard.usedBytes -= shard.entries[position].cost;
+        shard.positions.erase(shard.entries[position].key);
+        if (position + 1 != shard.entries.size()) {
+            shard.entries[position] = std::move(shard.entries.back());
+            shard.positions[shard.entries[position].key] = position;
+        }
+        shard.entries.pop_back();
+    }
+
+public:
+    /**
+     * @brief Creates an empty cache.
+     *
+     * @param numShards Number of independently locked shards.
+     * @param budgetBytes Total memory budget for cached IDs and keys.
+     */
+    ResultCache(size_t numShards, size_t budgetBytes)
+            : shards(std::max<size_t>(1, numShards)), shardBudget(budgetBytes / std::max<size_t>(1, numShards)) {}
+
+    /**
+     * @brief Looks up the results of a query.
+     *
+     * @param generation Generation of the snapshot the query runs against.
+     * @param key The normalized query.
+     * @return The cached IDs, or nullptr on a miss.
+     */
+    std::shared_ptr<const std::vector<int>> find(uint64_t generation, const std::string &key) {
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        synchronize(shard, generation);
+        auto it = shard.positions.find(key);
+        if (it == shard.positions.end()) return nullptr;
+        Entry &entry = shard.entries[it->second];
+        entry.referenced = true;
+        return entry.ids;
+    }
+
+    /**
+     * @brief Stores the results of a query, evicting cold entries as needed.
+     *
+     * Results from an older generation than the cached ones, and results larger than a
+     * whole shard, are not stored.
+     */
+    void insert(uint64_t generation, const std::string &key, std::shared_ptr<const std::vector<int>> ids) {
+        size_t cost = ids->size() * sizeof(int) + key.size() + sizeof(Entry) + 32;
+        if (cost > shardBudget) return;
+
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (generation < shard.generation) return; // A reload happened while this query ran.
+        synchronize(shard, generation);
+
+        auto existing = shard.positions.find(key);
+        if (existing != shard.positions.end()) {
+            evict(shard, existing->second);
+        }
+        while (shard.usedBytes + cost > shardBudget) {
+            if (shard.hand >= shard.entries.size()) shard.hand = 0;
+            Entry &entry = shard.entries[shard.hand];
+            if (entry.referenced) {
+                entry.referenced = false; // Second chance.
+                ++shard.hand;
+            } else {
+                evict(shard, shard.hand);
+            }
+        }
+        shard.positions[key] = shard.entries.size();
+        shard.entries.push_back({key, std::move(ids), cost, false});
+        shard.usedBytes += cost;
+    }
+};
+
+/// Result sets of recent form searches, shared by all worker threads.
+ResultCache queryCache(16, 32 << 20);
+
+/**
+ * @brief One page of search results.
+ */
+struct SearchResults {
+    std::vector<int> ids; ///< IDs of the movies on the page, in display order.
+    size_t total = 0;     ///< Number of movies matching the search.
+    size_t offset = 0;    ///< Position of the page's first movie among all matches.
+    size_t limit = 0;     ///< Requested page size.
+};
+
+/**
+ * @brief Parse a non-negative count from a request parameter.
+ * @param text The parameter value.
+ * @param fallback Returned when the value is empty or not a number.
+ */
+size_t parseCount(std::string_view text, size_t fallback) {
+    size_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return text.empty() || error != std::errc() || end != text.data() + text.size() ? fallback : value;
+}
+
+/**
+ * @brief Turn a requested page size into the one that is served.
+ * @param requested The limit asked for; 0 selects the default.
+ * @return `RESULTS_PER_PAGE` for 0, otherwise the request capped at `MAX_RESULTS_PER_PAGE`.
+ */
+size_t pageLimit(size_t requested) {
+    return requested == 0 ? RESULTS_PER_PAGE : std::min<size_t>(requested, MAX_RESULTS_PER_PAGE);
+}
+
+/**
+ * @brief A web form search reduced to its normalized filters and the order of its results.
+ *
+ * `filters` has one bit per kind of filter the form fills in and selects the kernel that
+ * evaluates the search (see `runPlan`). All filters are intersected, so their order and
+ * repetitions do not change the result: genre words and keywords are sorted and deduplicated,
+ * and searches with the same result set get the same cache key.
+ */
+#include <utility>
+
+struct QueryPlan {
+    /// Bits of `filters`, one per kind of filter.
+    static constexpr unsigned GenreFilter = 1, YearFilter = 2, LanguageFilter = 4, KeywordFilter = 8;
+    static constexpr unsigned FILTER_COMBINATIONS = 16;
+
+    enum Order { Unordered, ByRating, ByYear, ByRelevance };
+
+    unsigned filters = 0;               ///< The filter bits of the non-empty filters.
+    std::vector<std::string> genres;    ///< Lowercase genre words.
+    std::string year;                   ///< Lowercase year, if filtered.
+    std::string language;               ///< Lowercase language, if filtered.
+    std::vector<std::string> keywords;  ///< Cleaned keywords.
+    Order order = Unordered;            ///< How the page is ordered.
+    bool descending = false;            ///< Whether the highest values come first.
+    size_t offset = 0;                  ///< Position of the first requested movie among all matches.
+    size_t limit = RESULTS_PER_PAGE;    ///< Requested page size.
+    std::string cacheKey;               ///< The normalized filters.
+};
+
+/**
+ * @brief Get a submitted form field without adding it to the map.
+ * @return The field's value, or an empty view if it was not submitted.
+ */
+std::string_view formField(const std::unordered_map<std::string, std::string> &params, const std::string &name) {
+    auto it = params.find(name);
+    return it == params.end() ? std::string_view() : std::string_view(it->second);
+}
+
+/**
+ * @brief Normalize the fields of the web form into a query plan.
+ * @param params The decoded form fields ("genre", "year", "language", "keywords", "sort", "offset", "limit").
+ */
+QueryPlan planQuery(const std::unordered_map<std::string, std::string> &params) {
+    QueryPlan plan;
+    std::string buffer;
+    std::string_view genreInput = formField(params, "genre");
+    // Genre words are separated by '+' or spaces.
+    for (std::string_view word = InvertedIndex::nextToken(genreInput, " \t\n\v\f\r+"); !word.empty();
+         word = InvertedIndex::nextToken(genreInput, " \t\n\v\f\r+")) {
+        plan.genres.emplace_back(InvertedIndex::lowercase(word, buffer));
+    }
+    plan.year = InvertedIndex::lowercase(formField(params, "year"), buffer);
+    plan.language = InvertedIndex::lowercase(formField(params, "language"), buffer);
+
+    std::string_view keywordInput = formField(params, "keywords");
+    for (std::string_view token = InvertedIndex::nextToken(keywordInput, "+"); !token.empty();
+         token = InvertedIndex::nextToken(keywordInput, "+")) {
+        std::string_view keyword = InvertedIndex::normalizeWord(token, buffer);
+        if (!keyword.empty()) {
+            plan.keywords.emplace_back(keyword);
+        }
+    }
+
+    std::sort(plan.genres.begin(), plan.genres.end());
+    plan.genres.erase(std::unique(plan.genres.begin(), plan.genres.end()), plan.genres.end());
+    std::sort(plan.keywords.begin(), plan.keywords.end());
+    plan.keywords.erase(std::unique(plan.keywords.begin(), plan.keywords.end()), plan.keywords.end());
+
+    plan.filters = (plan.genres.empty() ? 0 : QueryPlan::GenreFilter) | (plan.year.empty() ? 0 : QueryPlan::YearFilter) |
+                   (plan.language.empty() ? 0 : QueryPlan::LanguageFilter) |
+                   (plan.keywords.empty() ? 0 : QueryPlan::KeywordFilter);
+
+    // One entry per filter, in the order of the category names.
+    auto addKey = [&](const char *category, std::string_view word) {
+        plan.cacheKey += category;
+        plan.cacheKey += '_';
+        plan.cacheKey += word;
+        plan.cacheKey += '\0';
+    };
+    for (const auto &genre: plan.genres) addKey("genre", genre);
+    if (!plan.language.empty()) addKey("language", plan.language);
+    if (!plan.year.empty()) addKey("year", plan.year);
+    for (const auto &word: plan.keywords) addKey("keyword", word);
+
+    std::string_view sort = formField(params, "sort");
+    if (sort == "rating_asc" || sort == "rating_desc") {
+        plan.order = QueryPlan::ByRating;
+    } else if (sort == "year_asc" || sort == "year_desc") {
+        plan.order = QueryPlan::ByYear;
+    } else if (sort == "relevance") {
+        plan.order = QueryPlan::ByRelevance;
+    }
+    plan.descending = sort.ends_with("_desc");
+    plan.offset = parseCount(formField(params, "offset"), 0);
+    plan.limit = pageLimit(parseCount(formField(params, "limit"), RESULTS_PER_PAGE));
+    return plan;
+}
+
+/**
+ * @brief Finds the movies matching the filters of a plan; one instance per combination of filters.
+ *
+ * The facets (genre words, year, language) are looked up first, since that is a hash probe
+ * each: a missing one matches nothing, and the keywords are then not even expanded. A form
+ * with only facets and a single list just decodes it. Keywords are intersected as unions of
+ * the words they match, except when the smallest facet list bounds the result to so few
+ * movies that probing the keyword's lists for them is cheaper than building the union: those
+ * keywords filter the intersection afterwards. An empty form matches nothing.
+ *
+ * @tparam Filters The filter bits of the plan.
+ * @param index The index to search.
+ * @param plan The normalized search.
+ * @param out Receives the sorted matching movie IDs.
+ */
+template <unsigned Filters>
+void runPlan(const InvertedIndex &index, const QueryPlan &plan, std::vector<int> &out) {
+    out.clear();
+    if constexpr (Filters != 0) {
+        thread_local IntersectionEngine engine;
+        thread_local std::vector<const PostingList *> facetLists;
+        engine.clear();
+        facetLists.clear();
+
+        auto facetStart = std::chrono::steady_clock::now();
+        if constexpr ((Filters & QueryPlan::GenreFilter) != 0) {
+            for (const auto &genre: plan.genres) facetLists.push_back(index.findList(InvertedIndex::Genre, genre));
+        }
+        if constexpr ((Filters & QueryPlan::YearFilter) != 0) {
+            facetLists.push_back(index.findList(InvertedIndex::Year, plan.year));
+        }
+        if constexpr ((Filters & QueryPlan::LanguageFilter) != 0) {
+            facetLists.push_back(index.findList(InvertedIndex::Language, plan.language));
+        }
+        size_t bound = std::numeric_limits<size_t>::max(); // No result set is larger than its smallest list.
+        for (const PostingList *list: facetLists) {
+            if (!list) return;
+            bound = std::min(bound, list->size());
+            engine.addList(list);
+        }
+
+        auto keywordStart = std::chrono::steady_clock::now();
+        thread_local std::vector<std::vector<const PostingList *>> probed;
+        size_t probedUsed = 0;
+        if constexpr ((Filters & QueryPlan::KeywordFilter) != 0) {
+            thread_local std::vector<const PostingList *> wordLists;
+            for (const auto &word: plan.keywords) {
+                wordLists.clear();
+                index.findKeywordLists(word, wordLists);
+                if (wordLists.empty()) return;
+                if constexpr (Filters != QueryPlan::KeywordFilter) {
+                    if (IntersectionEngine::probeCost(wordLists, bound) < IntersectionEngine::unionCost(wordLists)) {
+                        if (probedUsed == probed.size()) probed.emplace_back();
+                        probed[probedUsed++] = wordLists;
+                        continue;
+                    }
+                }
+                engine.addUnion(wordLists);
+            }
+        } else if (facetLists.size() == 1) {
+            facetLists.front()->decode(out);
+            Metrics::record(Metrics::Facets, std::chrono::steady_clock::now() - facetStart);
+            return;
+        }
+
+        auto intersectStart = std::chrono::steady_clock::now();
+        engine.run(out);
+        for (size_t i = 0; i < probedUsed && !out.empty(); ++i) {
+            IntersectionEngine::filterByUnion(out, probed[i]);
+        }
+        Metrics::record(Metrics::Facets, keywordStart - facetStart);
+        Metrics::record(Metrics::Keywords, intersectStart - keywordStart);
+        Metrics::record(Metrics::Intersect, std::chrono::steady_clock::now() - intersectStart);
+    }
+}
+
+/**
+ * @brief A `runPlan` instance.
+ */
+using PlanKernel = void (*)(const InvertedIndex &, const QueryPlan &, std::vector<int> &);
+
+template <unsigned... Filters>
+constexpr std::array<PlanKernel, sizeof...(Filters)> makePlanKernels(std::integer_sequence<unsigned, Filters...>) {
+    return {&runPlan<Filters>...};
+}
+
+/// The kernel for every combination of filters, indexed by `QueryPlan::filters`.
+constexpr std::array<PlanKernel, QueryPlan::FILTER_COMBINATIONS> planKernels =
+        makePlanKernels(std::make_integer_sequence<unsigned, QueryPlan::FILTER_COMBINATIONS>());
+
+/**
+ * @brief Runs the search submitted through the web form.
+ *
+ * The form is normalized into a `QueryPlan`, whose filter combination selects the kernel that
+ * intersects the filters (genre words, year, language, and each keyword). The matching movies
+ * are then sorted by rating if the form asks for it (or by year, with "year_asc"/"year_desc",
+ * or by the BM25 relevance of their titles and overviews to the keywords, with "relevance").
+ * The unsorted result set is cached under the normalized filters, so re-sorting the same
+ * search skips the intersection. Only the page selected by "offset" and "limit" is ordered
+ * and returned.
+ *
+ * @param snapshot The data snapshot to search.
+ * @param params The decoded form fields ("genre", "year", "language", "keywords", "sort", "offset", "limit").
+ * @param cache Where result sets are looked up and stored, or nullptr to always search.
+ * @return The requested page of matching movies.
+ */
+SearchResults searchMovies(const MovieSnapshot &snapshot, const std::unordered_map<std::string, std::string> &params,
+                           ResultCache *cache = &queryCache) {
+    QueryPlan plan = planQuery(params);
+
+    std::shared_ptr<const std::vector<int>> matches = cache ? cache->find(snapshot.generation, plan.cacheKey) : nullptr;
+    if (cache) Metrics::add(matches ? Metrics::CacheHits : Metrics::CacheMisses);
+    if (!matches) {
+        auto ids = std::make_shared<std::vector<int>>();
+        planKernels[plan.filters](snapshot.index, plan, *ids);
+        matches = ids;
+        if (cache) cache->insert(snapshot.generation, plan.cacheKey, matches);
+    }
+
+    // Sorting is applied on top of the (possibly cached) result set, using the precomputed orders.
+    SearchResults page;
+    page.total = matches->size();
+    page.offset = plan.offset;
+    page.limit = plan.limit;
+    size_t first = std::min(page.offset, page.total);
+    size_t last = first + std::min(page.limit, page.total - first);
+    if (plan.order == QueryPlan::Unordered) {
+        page.ids.assign(matches->begin() + first, matches->begin() + last);
+        return page;
+    }
+    // Select the movies up to the end of the page, then drop those on earlier pages.
+    Metrics::Timer timer(Metrics::Sort);
+    if (plan.order == QueryPlan::ByRelevance) {
+        snapshot.index.rankByRelevance(plan.keywords, *matches, last, page.ids);
+    } else {
+        const SortOrder &order = plan.order == QueryPlan::ByRating ? snapshot.byRating : snapshot.byYear;
+        order.select(*matches, plan.descending, last, page.ids);
+    }
+    page.ids.erase(page.ids.begin(), page.ids.begin() + first);
+    return page;
+}
+
+/**
+ * @brief A parsed client request.
+ *
+ * All fields are views into the connection's receive buffer and stay valid until the
+ * buffer is modified.
+ */
+struct HttpRequest {
+    std::string_view method; ///< "GET", "POST", ... or "SEARCH" for the line and binary protocols.
+    std::string_view target; ///< Request target (HTTP), or the keywords of a SEARCH command.
+    std::string_view version; ///< "HTTP/1.x"; empty for SEARCH.
+    std::string_view headers; ///< Raw header lines after the request line.
+    std::string_view body; ///< Request body of `Content-Length` bytes, or the payload of a binary frame.
+    bool keepAlive = false; ///< Whether the connection stays open after the response.
+    bool binary = false; ///< Whether the request is a SEARCH in a frame of the binary protocol.
+
+    /**
+     * @brief The target without its query string.
+     */
+    std::string_view path() const {
+        return target.substr(0, target.find('?'));
+    }
+
+    /**
+     * @brief Looks up a header value by case-insensitive name.
+     * @return The trimmed value, or an empty view if the header is absent.
+     */
+    std::string_view header(std::string_view name) const {
+        std::string_view rest = headers;
+        while (!rest.empty()) {
+            size_t lineEnd = rest.find("\r\n");
+            std::string_view line = rest.substr(0, lineEnd);
+            rest = lineEnd == std::string_view::npos ? std::string_view() : rest.substr(lineEnd + 2);
+
+            size_t colon = line.find(':');
+            if (colon == name.size() && equalsIgnoreCase(line.substr(0, colon), name)) {
+                std::string_view value = line.substr(colon + 1);
+                while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+                while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+                return value;
+            }
+        }
+        return {};
+    }
+
+    /**
+     * @brief Compares two ASCII strings ignoring case.
+     */
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    /**
+     * @brief Checks whether a comma-separated header value contains a token, ignoring case.
+     */
+    static bool hasToken(std::string_view value, std::string_view token) {
+        while (!value.empty()) {
+            size_t comma = value.find(',');
+            std::string_view item = value.substr(0, comma);
+            while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+            while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+            if (equalsIgnoreCase(item, token)) return true;
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief Framing of the binary search protocol, an alternative to the SEARCH line command.
+ *
+ * A request frame is the four magic bytes, the payload length as a little-endian 32-bit
+ * integer, and the payload: the offset and limit of the requested page (32 bits each)
+ * followed by the keywords as space-separated text; the limit goes through `pageLimit` like
+ * any other. The response frame has its own magic
+ * and the same length prefix; its payload holds the total number of matches, the number of
+ * listed movies, and then every movie as its ID and packed fields (see `searchFrame`).
+ * All integers are little-endian. The connection stays open, so a client can send any
+ * number of frames, also pipelined, and read the responses in order.
+ *
+ * The first magic byte is not ASCII, so a frame is never mistaken for a text request.
+ */
+struct BinaryProtocol {
+    static constexpr char REQUEST_MAGIC[4] = {'\xC7', 'C', 'W', 'Q'};
+    static constexpr char RESPONSE_MAGIC[4] = {'\xC7', 'C', 'W', 'R'};
+    static constexpr size_t HEADER_SIZE = 8;       ///< Magic and payload length.
+    static constexpr size_t MIN_REQUEST_PAYLOAD = 8; ///< Offset and limit.
+
+    /**
+     * @brief Read a little-endian 32-bit integer.
+     */
+    static uint32_t readU32(const char *p) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(p);
+        return uint32_t{bytes[0]} | uint32_t{bytes[1]} << 8 | uint32_t{bytes[2]} << 16 | uint32_t{bytes[3]} << 24;
+    }
+
+    /**
+     * @brief Append the low `size` bytes of an integer in little-endian order.
+     */
+    static void append(std::string &out, uint32_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            out += static_cast<char>(value >> (8 * i) & 0xFF);
+        }
+    }
+};
+
+/**
+ * @brief Incremental parser for the requests arriving on one connection.
+ *
+ * The parser is fed the unprocessed part of the receive buffer each time more bytes arrive.
+ * It remembers how far it has already searched for the end of the headers, so a request that
+ * trickles in over many segments is scanned only once, and it never copies request data.
+ * After a complete request has been handled, `reset` prepares it for the next one.
+ */
+class RequestParser {
+public:
+    /**
+     * @brief Result of feeding the parser.
+     */
+    enum Status { Incomplete, Complete, Invalid };
+
+    /// Largest accepted request line plus headers (or SEARCH line), in bytes.
+    static constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+    /// Largest accepted request body, in bytes.
+    static constexpr size_t MAX_BODY_SIZE = 1 << 20;
+
+    /**
+     * @brief Parses the request at the start of the buffer.
+     *
+     * @param buffer The received bytes that have not been consumed by earlier requests.
+     * @param request Filled with views into `buffer` when the request is complete.
+     * @param atEnd Whether the client has finished sending; completes a SEARCH line without a newline.
+     * @return Whether the request is complete, needs more bytes, or is malformed.
+     */
+    Status parse(std::string_view buffer, HttpRequest &request, bool atEnd = false) {
+        if (invalid) return Invalid;
+        if (headerEnd == std::string_view::npos) {
+            Status status = findHeaderEnd(buffer, atEnd);
+            invalid = status == Invalid;
+            if (status != Complete) return status;
+        }
+        if (buffer.size() < length) return Incomplete;
+
+        request = HttpRequest();
+        if (binary) {
+            request.method = "SEARCH";
+            request.body = buffer.substr(BinaryProtocol::HEADER_SIZE, length - BinaryProtocol::HEADER_SIZE);
+            request.binary = true;
+            request.keepAlive = true;
+            return Complete;
+        }
+        std::string_view requestLine = buffer.substr(0, lineEnd);
+        if (search) {
+            request.method = requestLine.substr(0, 6);
+            request.target = requestLine.substr(std::min<size_t>(7, requestLine.size()));
+            return Complete;
+        }
+        size_t methodEnd = requestLine.find(' ');
+        size_t targetEnd = requestLine.rfind(' ');
+        request.method = requestLine.substr(0, methodEnd);
+        request.target = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+        request.version = requestLine.substr(targetEnd + 1);
+        request.headers = buffer.substr(std::min(lineEnd + 2, headerEnd), headerEnd - std::min(lineEnd + 2, headerEnd));
+        request.body = buffer.substr(headerEnd + 4, length - headerEnd - 4);
+
+        // HTTP/1.1 persists unless told otherwise; HTTP/1.0 only on request.
+        std::string_view connection = request.header("Connection");
+        request.keepAlive = request.version == "HTTP/1.1" ? !HttpRequest::hasToken(connection, "close")
+                                                          : HttpRequest::hasToken(connection, "keep-alive");
+        return Complete;
+    }
+
+    /**
+     * @brief The number of bytes taken by the complete request.
+     */
+    size_t size() const {
+        return length;
+    }
+
+    /**
+     * @brief Whether the request is a frame of the binary protocol, known once its first byte arrived.
+     */
+    bool isBinary() const {
+        return binary;
+    }
+
+    /**
+     * @brief Prepares the parser for the next request on the connection.
+     */
+    void reset() {
+        *this = RequestParser();
+    }
+
+private:
+    size_t scanned = 0; ///< Bytes already searched for the end of the headers.
+    size_t lineEnd = std::string_view::npos; ///< End of the request line.
+    size_t headerEnd = std::string_view::npos; ///< Offset of the blank line, or npos while unknown.
+    size_t length = 0; ///< Total request length once the headers are known.
+    bool search = false; ///< Whether the request is a SEARCH command.
+    bool binary = false; ///< Whether the request is a binary protocol frame.
+    bool invalid = false; ///< Whether the request was found malformed.
+
+    /**
+     * @brief Looks for the end of the request line and headers and validates them.
+     */
+    Status findHeaderEnd(std::string_view buffer, bool atEnd) {
+        if (!buffer.empty() && buffer[0] == BinaryProtocol::REQUEST_MAGIC[0]) {
+            binary = true;
+            std::string_view magic(BinaryProtocol::REQUEST_MAGIC, sizeof(BinaryProtocol::REQUEST_MAGIC));
+            if (buffer.substr(0, magic.size()) != magic.substr(0, std::min(buffer.size(), magic.size()))) return Invalid;
+            if (buffer.size() < BinaryProtocol::HEADER_SIZE) return atEnd ? Invalid : Incomplete;
+            size_t payload = BinaryProtocol::readU32(buffer.data() + magic.size());
+            if (payload < BinaryProtocol::MIN_REQUEST_PAYLOAD || payload > MAX_HEADER_SIZE) return Invalid;
+            lineEnd = 0;
+            headerEnd = BinaryProtocol::HEADER_SIZE;
+            length = BinaryProtocol::HEADER_SIZE + payload;
+            return Complete;
+        }
+
+        std::string_view command = "SEARCH";
+        if (buffer.substr(0, command.size()) == command.substr(0, std::min(buffer.size(), command.size()))) {
+            if (buffer.size() < command.size()) return atEnd ? Invalid : Incomplete;
+            size_t newline = buffer.find('\n', scanned);
+            scanned = buffer.size();
+            if (newline == std::string_view::npos) {
+                if (buffer.size() > MAX_HEADER_SIZE) return Invalid;
+                if (!atEnd) return Incomplete;
+                newline = buffer.size();
+            }
+            search = true;
+            headerEnd = newline;
+            length = std::min(newline + 1, buffer.size());
+            lineEnd = newline > 0 && buffer[newline - 1] == '\r' ? newline - 1 : newline;
+            return Complete;
+        }
+
+        // Resume the search a few bytes early in case the terminator straddles two segments.
+        size_t end = buffer.find("\r\n\r\n", scanned < 3 ? 0 : scanned - 3);
+        scanned = buffer.size();
+        if (end == std::string_view::npos) {
+            return buffer.size() > MAX_HEADER_SIZE || atEnd ? Invalid : Incomplete;
+        }
+        if (end > MAX_HEADER_SIZE) return Invalid;
+
+        lineEnd = buffer.find("\r\n");
+        std::string_view requestLine = buffer.substr(0, lineEnd);
+        size_t methodEnd = requestLine.find(' ');
+        size_t targetEnd = requestLine.rfind(' ');
+        if (methodEnd == std::string_view::npos || methodEnd == 0 || targetEnd <= methodEnd + 1 ||
+            requestLine.substr(targetEnd + 1).substr(0, 7) != "HTTP/1.") {
+            return Invalid;
+        }
+
+        HttpRequest headers;
+        headers.headers = buffer.substr(std::min(lineEnd + 2, end), end - std::min(lineEnd + 2, end));
+        if (!headers.header("Transfer-Encoding").empty()) return Invalid; // Chunked bodies are not supported.
+        size_t contentLength = 0;
+        std::string_view value = headers.header("Content-Length");
+        if (!value.empty() && (std::from_chars(value.data(), value.data() + value.size(), contentLength).ptr !=
+                               value.data() + value.size() || contentLength > MAX_BODY_SIZE)) {
+            return Invalid;
+        }
+        headerEnd = end;
+        length = end + 4 + contentLength;
+        return Complete;
+    }
+};
+
+/**
+ * @brief Frames a response body as an HTTP/1.1 response.
+ *
+ * @param status The status line text, e.g. "200 OK".
+ * @param contentType The MIME type of the body.
+ * @param body The response body.
+ * @param keepAlive Whether the connection stays open for further requests.
+ * @param extraHeaders Further header lines, each ending with CRLF.
+ * @return The status line, headers and body.
+ */
+std::string httpResponse(const std::string &status, const std::string &contentType, const std::string &body,
+                         bool keepAlive, const std::string &extraHeaders = "") {
+    std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType +
+                           "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: " + (keepAlive ? "keep-alive" : "close") + "\r\n" + extraHeaders +
+                           "\r\n";
+    response += body;
+    return response;
+}
+
+/**
+ * @brief Builds the status line and headers of an HTTP/1.1 response whose body follows in chunks.
+ *
+ * @param status The status line text, e.g. "200 OK".
+ * @param contentType The MIME type of the body.
+ * @param keepAlive Whether the connection stays open for further requests.
+ * @return The status line and headers.
+ */
+std::string httpChunkedHead(const std::string &status, const std::string &contentType, bool keepAlive) {
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType + "\r\nTransfer-Encoding: chunked\r\nConnection: " +
+           (keepAlive ? "keep-alive" : "close") + "\r\n\r\n";
+}
+
+/**
+ * @brief Renders the HTML search form with the genres, years and languages of a snapshot.
+ *
+ * @param snapshot The data whose facets fill the dropdowns.
+ * @return The page body.
+ */
+std::string renderLandingPage(const MovieSnapshot &snapshot) {
+    std::ostringstream response;
+
+    // Opening HTML structure.
+    response << R"(
+<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>Movie Search</title>
+    <style>
+        body {
+            font-family: Arial, sans-serif;
+            background-color: #f5f5f5;
+            display: flex;
+            justify-content: center;
+            align-items: center;
+            min-height: 100vh;
+            margin: 0;
+        }
+        .container {
+            background: #fff;
+            padding: 20px;
+            border-radius: 8px;
+            box-shadow: 0 4px 6px rgba(0, 0, 0, 0.1);
+            width: 400px;
+        }
+        h1 {
+            text-align: center;
+            margin-bottom: 20px;
+        }
+        label {
+            font-weight: bold;
+            display: block;
+            margin-top: 10px;
+        }
+        select, input[type="text"], button {
+            width: 100%;
+            padding: 10px;
+            margin-top: 5px;
+            margin-bottom: 15px;
+            border: 1px solid #ccc;
+            border-radius: 5px;
+        }
+        button {
+            background-color: #007bff;
+            color: #fff;
+            font-weight: bold;
+            border: none;
+            cursor: pointer;
+        }
+        button:hover {
+            background-color: #0056b3;
+        }
+    </style>
+</head>
+<body>
+    <div class="container">
+        <h1>Movie Search</h1>
+        <form method="POST">
+)";
+
+    // Dropdown for genres.
+    response << "<label for='genre'>Genre:</label>";
+    response << "<select name='genre' id='genre'>";
+    response << "<option value=''>Any</option>";
+    for (const auto &genre: snapshot.genres) {
+        response << "<option value='" << genre << "'>" << genre << "</option>";
+    }
+    response << "</select>";
+
+    // Dropdown for years.
+    response << "<label for='year'>Year:</label>";
+    response << "<select name='year' id='year'>";
+    response << "<option value=''>Any</option>";
+    for (const auto &year: snapshot.years) {
+        response << "<option value='" << year << "'>" << year << "</option>";
+    }
+    response << "</select>";
+
+    // Dropdown for languages.
+    response << "<label for='language'>Language:</label>";
+    response << "<select name='language' id='language'>";
+    response << "<option value=''>Any</option>";
+    for (const auto &lang: snapshot.languages) {
+        response << "<option value='" << lang << "'>" << lang << "</option>";
+    }
+    response << "</select>";
+
+    // Input field for keywords.
+    response << "<label for='keywords'>Keywords:</label>";
+    response
+            << "<input type='text' name='keywords' id='keywords' placeholder='Enter your search keywords separated by a space'>";
+
+    // Submit button and closing HTML.
+    response << "<button type='submit'>Search</button>";
+    response << R"(
+        </form>
+    </div>
+</body>
+</html>
+)";
+    return response.str();
+}
+
+/**
+ * @brief The landing page of one snapshot, ready to be sent.
+ */
+struct LandingPage {
+    uint64_t generation; ///< Generation of the snapshot the page was rendered from.
+    std::string etag; ///< Quoted entity tag: a hash of the page body.
+    std::string responses[2]; ///< Complete responses for `Connection: close` and `keep-alive`.
+};
+
+std::atomic<std::shared_ptr<const LandingPage>> currentLandingPage;
+
+/**
+ * @brief Get the landing page of a snapshot, rendering it on first use.
+ *
+ * The page only changes when new data is published, so it is cached together with its
+ * framing and ETag and rebuilt once per snapshot generation.
+ *
+ * @param snapshot The snapshot the request is served from.
+ * @return The cached page.
+ */
+std::shared_ptr<const LandingPage> acquireLandingPage(const std::shared_ptr<const MovieSnapshot> &snapshot) {
+    std::shared_ptr<const LandingPage> page = currentLandingPage.load(std::memory_order_acquire);
+    if (page && page->generation == snapshot->generation) {
+        return page;
+    }
+
+    // Several threads may render the same generation at once; any of the results will do.
+    auto rendered = std::make_shared<LandingPage>();
+    rendered->generation = snapshot->generation;
+    std::string body = renderLandingPage(*snapshot);
+    std::ostringstream etag;
+    etag << '"' << std::hex << hashBytes(body.data(), body.size()) << '"';
+    rendered->etag = etag.str();
+    for (bool keepAlive: {false, true}) {
+        rendered->responses[keepAlive] = httpResponse("200 OK", "text/html", body, keepAlive,
+                                                      "ETag: " + rendered->etag + "\r\nCache-Control: no-cache\r\n");
+    }
+    currentLandingPage.store(rendered, std::memory_order_release);
+    return rendered;
+}
+
+/**
+ * @brief Appends text and numbers to a string, formatted as `std::ostream` would format them.
+ *
+ * Response bodies are written with this instead of a `std::ostringstream`, so they go
+ * straight into the buffer that is sent.
+ */
+#include <type_traits>
+
+struct ResponseWriter {
+    std::string &out; ///< The buffer appended to.
+
+    ResponseWriter &operator<<(std::string_view text) {
+        out.append(text);
+        return *this;
+    }
+
+    ResponseWriter &operator<<(char c) {
+        out += c;
+        return *this;
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>>
+    ResponseWriter &operator<<(T value) {
+        char digits[32];
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<T>) {
+            result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+        } else {
+            result = std::to_chars(digits, digits + sizeof(digits), value);
+        }
+        out.append(digits, result.ptr - digits);
+        return *this;
+    }
+};
+
+/**
+ * @brief A response body that is rendered piece by piece while it is being sent.
+ *
+ * Long result listings are never built in memory as a whole: the connection asks for the
+ * next piece whenever the previous one has been sent, so the first bytes leave as soon as
+ * the head of the page is rendered and a response holds little more than one piece.
+ */
+class ResponseBody {
+public:
+    bool chunked = false; ///< Whether pieces are framed as HTTP/1.1 chunks; otherwise the body ends with the connection.
+
+    virtual ~ResponseBody() = default;
+
+    /**
+     * @brief Renders the next piece of the body.
+     * @param out Appended to; rendering stops once it holds about `size` bytes.
+     * @return True while more of the body follows.
+     */
+    virtual bool render(std::string &out, size_t size) = 0;
+
+    /**
+     * @brief Renders the next piece and records the time of all pieces once the body is complete.
+     */
+    bool next(std::string &out, size_t size) {
+        auto start = std::chrono::steady_clock::now();
+        bool more = render(out, size);
+        renderTime += std::chrono::steady_clock::now() - start;
+        if (!more) Metrics::record(Metrics::Render, renderTime);
+        return more;
+    }
+
+    /**
+     * @brief Renders the whole body at once, e.g. for a response with a Content-Length.
+     */
+    std::string renderAll() {
+        std::string body;
+        while (next(body, SIZE_MAX)) {
+        }
+        return body;
+    }
+
+private:
+    std::chrono::steady_clock::duration renderTime{}; ///< Time spent rendering the pieces so far.
+};
+
+/**
+ * @brief The HTML page listing the results of a web form search, rendered a few movies at a time.
+ */
+class ResultsPage : public ResponseBody {
+    std::shared_ptr<const MovieSnapshot> snapshot; ///< Keeps the listed movies alive while the page is sent.
+    std::unordered_map<std::string, std::string> params; ///< The submitted form fields.
+    SearchResults page; ///< The movies shown on the page.
+    size_t first; ///< Position of the first shown movie among all matches.
+    size_t next = 0; ///< Index into `page.ids` of the next movie to render.
+    bool started = false; ///< Whether the head of the page has been rendered.
+
+    /**
+     * @brief Renders a form that re-submits the search, e.g. for another sort order or page.
+     */
+    void searchForm(ResponseWriter &out, const std::string &sort, size_t offset, const char *label) {
+        out << R"(
+    <form method="POST" style="display: inline;">
+        <input type="hidden" name="genre" value=")" << params["genre"] << R"(">
+        <input type="hidden" name="year" value=")" << params["year"] << R"(">
+        <input type="hidden" name="language" value=")" << params["language"] << R"(">
+        <input type="hidden" name="keywords" value=")" << params["keywords"] << R"(">
+        <input type="hidden" name="sort" value=")" << sort << R"(">
+        <input type="hidden" name="offset" value=")" << offset << R"(">
+        <input type="hidden" name="limit" value=")" << page.limit << R"(">
+        <button type="submit" class="arrow-button">)" << label << R"(</button>
+    </form>)";
+    }
+
+public:
+    /**
+     * @brief Runs the search; the page is rendered later.
+     * @param snapshot The data snapshot to search.
+     * @param params The decoded form fields.
+     */
+    ResultsPage(std::shared_ptr<const MovieSnapshot> snapshot, std::unordered_map<std::string, std::string> params)
+            : snapshot(std::move(snapshot)), params(std::move(params)) {
+        page = searchMovies(*this->snapshot, this->params);
+        first = std::min(page.offset, page.total);
+    }
+
+    bool render(std::string &buffer, size_t size) override {
+        ResponseWriter out{buffer};
+        const MovieStore &movies = snapshot->movies;
+        if (!started) {
+            started = true;
+            out << R"(
+<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>Movie Search Results</title>
+    <style>
+        @import url('https://fonts.googleapis.com/css2?family=Roboto:wght@400;500;700&display=swap');
+
+        body {
+            font-family: 'Roboto', sans-serif;
+            background-color: #f5f5f5;
+            margin: 0;
+            padding: 0;
+        }
+        .container {
+            max-width: 1000px;
+            margin: 20px auto;
+            background: #fff;
+            padding: 20px;
+            border-radius: 8px;
+            box-shadow: 0 4px 6px rgba(0, 0, 0, 0.1);
+        }
+        .header {
+            display: flex;
+            justify-content: space-between;
+            align-items: center;
+            margin-bottom: 20px;
+        }
+        .header h1 {
+            margin: 0;
+            font-size: 24px;
+            color: #333;
+        }
+        .sort-buttons {
+            display: flex;
+            align-items: center;
+            gap: 10px;
+        }
+        .sort-buttons .sort-label {
+            font-size: 16px;
+            font-weight: 500;
+            color: #333;
+        }
+        .arrow-button {
+            background-color: #007bff;
+            color: #fff;
+            border: none;
+            border-radius: 4px;
+            padding: 5px 10px;
+            font-size: 16px;
+            cursor: pointer;
+            line-height: 1;
+        }
+        .arrow-button:hover {
+            background-color: #0056b3;
+        }
+        .movie-list {
+            list-style: none;
+            padding: 0;
+        }
+        .movie-item {
+            display: flex;
+            align-items: flex-start;
+            padding: 15px;
+            border-bottom: 1px solid #ddd;
+        }
+        .movie-item:last-child {
+            border-bottom: none;
+        }
+        .poster {
+            flex: 0 0 120px;
+            margin-right: 15px;
+        }
+        .poster img {
+            width: 120px;
+            height: auto;
+            border-radius: 4px;
+        }
+        .details {
+            flex: 1;
+        }
+        .title {
+            font-size: 18px;
+            font-weight: bold;
+            margin: 0;
+            color: #007bff;
+        }
+        .title:hover {
+            text-decoration: underline;
+            cursor: pointer;
+        }
+        .info {
+            font-size: 14px;
+            color: #555;
+            margin-top: 5px;
+        }
+        .rating {
+            color: #f39c12;
+            font-weight: bold;
+        }
+        .genres {
+            font-size: 14px;
+            color: #777;
+            margin-top: 5px;
+        }
+        .overview {
+            margin-top: 10px;
+            font-size: 14px;
+            color: #333;
+        }
+        .pages {
+            display: flex;
+            justify-content: center;
+            align-items: center;
+            gap: 10px;
+            margin-top: 20px;
+        }
+    </style>
+</head>
+<body>
+    <div class="container">
+        <div class="header">
+            <h1>Movie Search Results</h1>
+            <div class="sort-buttons">
+<span class="sort-label">Sort by Rating</span>)";
+            searchForm(out, "rating_asc", 0, "&#9650;");
+            searchForm(out, "rating_desc", 0, "&#9660;");
+            if (!params["keywords"].empty()) {
+                out << R"(
+<span class="sort-label">Sort by Relevance</span>)";
+                searchForm(out, "relevance", 0, "&#9733;");
+            }
+            out << R"(
+            </div>
+        </div>
+        <ul class="movie-list">
+)";
+            if (page.ids.empty()) {
+                out << (page.total == 0 ? "No movies match your search criteria.\n" : "No more movies.\n");
+            }
+        }
+
+        for (; next < page.ids.size() && buffer.size() < size; ++next) {
+            int id = page.ids[next];
+            out << R"(<li class="movie-item">)"
+                << "<div class='poster'><img src='" << movies.posterUrl(id) << "' alt='Movie Poster'></div>"
+                << "<div class='details'>"
+                << "<p class='title'>" << movies.title(id) << "</p>"
+                << "<p class='info'>" << movies.year(id) << " | <span class='rating'>" << movies.rating(id)
+                << "</span> | "
+                << "<span class='language'>" << movies.language(id) << "</span></p>"
+                << "<p class='genres'>Genres: ";
+            for (size_t g = 0; g < movies.genreCount(id); ++g) {
+                out << (g ? ", " : "") << movies.genre(id, g);
+            }
+            out << "</p>"
+                << "<p class='overview'>" << movies.overview(id) << "</p>"
+                << "</div></li>";
+        }
+        if (next < page.ids.size()) return true;
+
+        out << R"(
+        </ul>)";
+
+        // Page navigation.
+        if (page.total > 0) {
+            out << "<div class='pages'>";
+            if (!page.ids.empty()) {
+                out << "<span class='sort-label'>Showing " << first + 1 << "-" << first + page.ids.size()
+                    << " of " << page.total << "</span>";
+            }
+            if (first > 0) {
+                searchForm(out, params["sort"], first - std::min(first, page.limit), "&#9664;");
+            }
+            if (first + page.ids.size() < page.total) {
+                searchForm(out, params["sort"], first + page.ids.size(), "&#9654;");
+            }
+            out << "</div>";
+        }
+        out << R"(
+    </div>
+</body>
+</html>
+)";
+        return false;
+    }
+};
+
+/**
+ * @brief The plain text answer to a SEARCH command, rendered a few movies at a time.
+ */
+class SearchListing : public ResponseBody {
+    std::shared_ptr<const MovieSnapshot> snapshot; ///< Keeps the listed movies alive while the listing is sent.
+    std::vector<int> results; ///< All matching movie IDs.
+    size_t first, last; ///< The range of `results` that is listed.
+    size_t next; ///< Position in `results` of the next movie to render.
+    size_t limit; ///< Requested page size.
+
+public:
+    /**
+     * @brief Prepares the listing of one page of keyword search results.
+     * @param snapshot The snapshot the results were found in.
+     * @param results The matching movie IDs.
+     * @param offset Number of results to skip.
+     * @param limit Maximum number of results to list.
+     */
+    SearchListing(std::shared_ptr<const MovieSnapshot> snapshot, std::vector<int> results, size_t offset, size_t limit)
+            : snapshot(std::move(snapshot)), results(std::move(results)), limit(limit) {
+        first = next = std::min(offset, this->results.size());
+        last = first + std::min(limit, this->results.size() - first);
+    }
+
+    bool render(std::string &buffer, size_t size) override {
+        ResponseWriter out{buffer};
+        const MovieStore &movies = snapshot->movies;
+        if (results.empty()) {
+            out << "No movies found\n"; // Inform the client if no matches are found.
+            return false;
+        }
+
+        // Iterate through the page of results and include movie details in the response.
+        for (; next < last && buffer.size() < size; ++next) {
+            int id = results[next];
+            out << "Title: " << movies.title(id) << "\n"
+                << "Year: " << movies.year(id) << "\n"
+                << "Rating: " << movies.rating(id) << "\n"
+                << "Language: " << movies.language(id) << "\n"
+                << "Genres: ";
+            for (size_t g = 0; g < movies.genreCount(id); ++g) {
+                out << movies.genre(id, g) << " "; // Append each genre to the response.
+            }
+            out << "\nOverview: " << movies.overview(id) << "\n\n";
+        }
+        if (next < last) return true;
+
+        if (last - first < results.size()) {
+            out << "Showing " << last - first << " of " << results.size() << " movies (offset=" << first
+                << " limit=" << limit << ")\n";
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief Builds the binary protocol response frame for one page of keyword search results.
  *
- * @param clientSocket The socket connected to the client.
+ * Every movie is packed as its u32 ID, u16 year, the IEEE-754 bits of its rating as u32,
+ * the language (u8 length and bytes), the genres (u8 count, then u8 length and bytes each),
+ * the title (u16 length and bytes) and the overview (u32 length and bytes). Longer strings
+ * are cut to what their length field can hold.
+ *
+ * @param movies The store the results refer to.
+ * @param results The matching movie IDs.
+ * @param offset Number of results to skip.
+ * @param limit Maximum number of results to list.
+ * @return The complete frame.
  */
-void handleClient(SOCKET clientSocket) {
-    char buffer[BUFFER_SIZE] = {0};   // Buffer to store the client's request.
-    int bytesReceived = recv(clientSocket, buffer, BUFFER_SIZE, 0);  // Read the request.
-    if (bytesReceived <= 0) {
-        closesocket(clientSocket); // Close the connection if no data is received.
-        return;
+std::string searchFrame(const MovieStore &movies, const std::vector<int> &results, size_t offset, size_t limit) {
+    size_t first = std::min(offset, results.size());
+    size_t last = first + std::min(limit, results.size() - first);
+    auto packString = [](std::string &out, std::string_view text, size_t lengthSize) {
+        text = text.substr(0, (size_t{1} << (8 * lengthSize)) - 1);
+        BinaryProtocol::append(out, static_cast<uint32_t>(text.size()), lengthSize);
+        out += text;
+    };
+
+    std::string frame(BinaryProtocol::RESPONSE_MAGIC, sizeof(BinaryProtocol::RESPONSE_MAGIC));
+    BinaryProtocol::append(frame, 0, 4); // Payload length, filled in below.
+    BinaryProtocol::append(frame, static_cast<uint32_t>(results.size()), 4);
+    BinaryProtocol::append(frame, static_cast<uint32_t>(last - first), 4);
+    for (size_t i = first; i < last; ++i) {
+        int id = results[i];
+        uint32_t rating;
+        float value = movies.rating(id);
+        std::memcpy(&rating, &value, sizeof(rating));
+        BinaryProtocol::append(frame, static_cast<uint32_t>(id), 4);
+        BinaryProtocol::append(frame, static_cast<uint32_t>(movies.year(id)), 2);
+        BinaryProtocol::append(frame, rating, 4);
+        packString(frame, movies.language(id), 1);
+        size_t genres = std::min<size_t>(movies.genreCount(id), 255);
+        BinaryProtocol::append(frame, static_cast<uint32_t>(genres), 1);
+        for (size_t g = 0; g < genres; ++g) {
+            packString(frame, movies.genre(id, g), 1);
+        }
+        packString(frame, movies.title(id), 2);
+        std::string_view overview = movies.overview(id);
+        BinaryProtocol::append(frame, static_cast<uint32_t>(overview.size()), 4);
+        frame += overview;
     }
 
-    std::string request(buffer); // Close the connection if no data is received.
-
-    // Handle GET requests: send an HTML form for movie search.
-    if (request.find("GET") != std::string::npos) {
-        std::ostringstream response;
-
-        // HTTP headers and opening HTML structure.
-        response << "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n";
-        response << R"(
-    <!DOCTYPE html>
-    <html lang="en">
-    <head>
-        <meta charset="UTF-8">
-        <meta name="viewport" content="width=device-width, initial-scale=1.0">
-        <title>Movie Search</title>
-        <style>
-            body {
-                font-family: Arial, sans-serif;
-                background-color: #f5f5f5;
-                display: flex;
-                justify-content: center;
-                align-items: center;
-                min-height: 100vh;
-                margin: 0;
-            }
-            .container {
-                background: #fff;
-                padding: 20px;
-                border-radius: 8px;
-                box-shadow: 0 4px 6px rgba(0, 0, 0, 0.1);
-                width: 400px;
-            }
-            h1 {
-                text-align: center;
-                margin-bottom: 20px;
-            }
-            label {
-                font-weight: bold;
-                display: block;
-                margin-top: 10px;
-            }
-            select, input[type="text"], button {
-                width: 100%;
-                padding: 10px;
-                margin-top: 5px;
-                margin-bottom: 15px;
-                border: 1px solid #ccc;
-                border-radius: 5px;
-            }
-            button {
-                background-color: #007bff;
-                color: #fff;
-                font-weight: bold;
-                border: none;
-                cursor: pointer;
-            }
-            button:hover {
-                background-color: #0056b3;
-            }
-        </style>
-    </head>
-    <body>
-        <div class="container">
-            <h1>Movie Search</h1>
-            <form method="POST">
-    )";
-
-        // Dropdown for genres.
-        response << "<label for='genre'>Genre:</label>";
-        response << "<select name='genre' id='genre'>";
-        response << "<option value=''>Any</option>";
-        for (const auto &genre: genres) {
-            response << "<option value='" << genre << "'>" << genre << "</option>";
-        }
-        response << "</select>";
-
-        // Dropdown for years.
-        response << "<label for='year'>Year:</label>";
-        response << "<select name='year' id='year'>";
-        response << "<option value=''>Any</option>";
-        for (const auto &year: years) {
-            response << "<option value='" << year << "'>" << year << "</option>";
-        }
-        response << "</select>";
-
-        // Dropdown for languages.
-        response << "<label for='language'>Language:</label>";
-        response << "<select name='language' id='language'>";
-        response << "<option value=''>Any</option>";
-        for (const auto &lang: languages) {
-            response << "<option value='" << lang << "'>" << lang << "</option>";
-        }
-        response << "</select>";
-
-        // Input field for keywords.
-        response << "<label for='keywords'>Keywords:</label>";
-        response
-                << "<input type='text' name='keywords' id='keywords' placeholder='Enter your search keywords separated by a space'>";
-
-        // Submit button and closing HTML.
-        response << "<button type='submit'>Search</button>";
-        response << R"(
-            </form>
-        </div>
-    </body>
-    </html>
-    )";
+    std::string length;
+    BinaryProtocol::append(length, static_cast<uint32_t>(frame.size() - BinaryProtocol::HEADER_SIZE), 4);
+    frame.replace(sizeof(BinaryProtocol::RESPONSE_MAGIC), 4, length);
+    return frame;
+}
+
+/**
+ * @brief Load and admission counters of the network front end, reported by GET /health.
+ */
+struct ServerStats {
+    std::atomic<int64_t> openConnections{0}; ///< Client connections currently open.
+    std::atomic<int64_t> queuedRequests{0}; ///< Connections with requests waiting for a worker.
+    std::atomic<uint64_t> acceptedConnections{0}; ///< Connections accepted since start.
+    std::atomic<uint64_t> rejectedConnections{0}; ///< Connections refused by the per-client limit.
+    std::atomic<uint64_t> shedRequests{0}; ///< Requests answered with 503 because the queue was full.
+    std::atomic<uint64_t> expiredRequests{0}; ///< Requests answered with 503 after the queue deadline.
+};
+
+ServerStats serverStats;
+
+/**
+ * @brief Renders the metrics and admission counters in the Prometheus text exposition format.
+ */
+std::string metricsExposition() {
+    Metrics::Totals totals = Metrics::collect();
+    std::string text;
+    ResponseWriter out{text};
+
+    // One histogram family for request handling and one for data loads, labelled by stage.
+    const char *families[] = {"coursework_request_stage_seconds", "coursework_load_phase_seconds"};
+    const char *help[] = {"Time spent in each stage of handling a request.",
+                          "Time spent in each phase of loading the movie data."};
+    const char *labels[] = {"stage", "phase"};
+    for (int family = 0; family < 2; ++family) {
+        out << "# HELP " << families[family] << " " << help[family] << "\n"
+            << "# TYPE " << families[family] << " histogram\n";
+        int begin = family == 0 ? 0 : Metrics::FIRST_LOAD_STAGE;
+        int end = family == 0 ? Metrics::FIRST_LOAD_STAGE : Metrics::STAGE_COUNT;
+        for (int stage = begin; stage < end; ++stage) {
+            std::string label = std::string(labels[family]) + "=\"" + Metrics::stageName(stage) + "\"";
+            uint64_t count = 0;
+            for (int bucket = 0; bucket < Metrics::BUCKET_COUNT; ++bucket) {
+                count += totals.buckets[stage][bucket];
+                out << families[family] << "_bucket{" << label << ",le=\"";
+                if (bucket + 1 < Metrics::BUCKET_COUNT) {
+                    out << static_cast<double>(Metrics::bucketBound(bucket)) * 1e-9;
+                } else {
+                    out << "+Inf";
+                }
+                out << "\"} " << count << "\n";
+            }
+            out << families[family] << "_sum{" << label << "} " << static_cast<double>(totals.sums[stage]) * 1e-9
+                << "\n" << families[family] << "_count{" << label << "} " << count << "\n";
+        }
+    }
+
+    auto counter = [&](const char *name, const char *description, uint64_t value) {
+        out << "# HELP " << name << " " << description << "\n# TYPE " << name << " counter\n"
+            << name << " " << value << "\n";
+    };
+    auto gauge = [&](const char *name, const char *description, int64_t value) {
+        out << "# HELP " << name << " " << description << "\n# TYPE " << name << " gauge\n"
+            << name << " " << value << "\n";
+    };
+    counter("coursework_requests_total", "Requests handled by a worker.", totals.counters[Metrics::Requests]);
+    counter("coursework_result_cache_hits_total", "Form searches answered from the result cache.",
+            totals.counters[Metrics::CacheHits]);
+    counter("coursework_result_cache_misses_total", "Form searches that ran the intersection.",
+            totals.counters[Metrics::CacheMisses]);
+    counter("coursework_sent_bytes_total", "Response bytes written to sockets.", totals.counters[Metrics::BytesSent]);
+    counter("coursework_accepted_connections_total", "Connections accepted since start.",
+            serverStats.acceptedConnections.load());
+    counter("coursework_rejected_connections_total", "Connections refused by the per-client limit.",
+            serverStats.rejectedConnections.load());
+    counter("coursework_shed_requests_total", "Requests answered with 503 because the queue was full.",
+            serverStats.shedRequests.load());
+    counter("coursework_expired_requests_total", "Requests answered with 503 after the queue deadline.",
+            serverStats.expiredRequests.load());
+    gauge("coursework_open_connections", "Client connections currently open.", serverStats.openConnections.load());
+    gauge("coursework_queued_requests", "Connections with requests waiting for a worker.",
+          serverStats.queuedRequests.load());
+    return text;
+}
+
+/**
+ * @brief Handles a client request and builds the appropriate response.
+ *
+ * This function processes a complete request received from a client, including GET and POST requests.
+ * - **GET**: Responds with an HTML form for movie search; GET /health reports the load counters.
+ * - **POST**: Processes search parameters, queries the inverted index, and returns search results.
+ * - **SEARCH**: (Custom command) Performs a keyword-based search and returns results in plain text.
+ *
+ * Other paths are answered with 404 and other methods with 405.
+ *
+ * Result listings can be streamed: if `stream` is given, it may receive the body of the
+ * response, which the caller renders piece by piece while sending it after the returned head.
+ *
+ * @param request The parsed request.
+ * @param keepAlive Whether the connection stays open after the response; announced in HTTP responses.
+ * @param stream Receives the body of a streamed response, or nullptr to return every response whole.
+ * @return The response to send back, or its head if the body was moved to `stream`.
+ */
+std::string handleRequest(const HttpRequest &request, bool keepAlive, std::unique_ptr<ResponseBody> *stream = nullptr) {
+    // Pin the current data snapshot for the whole request.
+    std::shared_ptr<const MovieSnapshot> snapshot = acquireSnapshot();
+    const InvertedIndex &invertedIndex = snapshot->index;
+
+    bool isRoot = request.path() == "/";
+
+    // Handle GET requests: send the HTML form for movie search, rendered once per snapshot.
+    if (request.method == "GET" && isRoot) {
+        std::shared_ptr<const LandingPage> page = acquireLandingPage(snapshot);
+        std::string_view ifNoneMatch = request.header("If-None-Match");
+        if (ifNoneMatch == "*" || HttpRequest::hasToken(ifNoneMatch, page->etag)) {
+            return "HTTP/1.1 304 Not Modified\r\nETag: " + page->etag + "\r\nConnection: " +
+                   (keepAlive ? "keep-alive" : "close") + "\r\n\r\n";
+        }
+        return page->responses[keepAlive];
+    }
+
+    // Report the admission counters, e.g. for a load balancer.
+    if (request.method == "GET" && request.path() == "/health") {
+        std::string body;
+        ResponseWriter out{body};
+        out << "status ok\n"
+            << "open_connections " << serverStats.openConnections.load() << "\n"
+            << "queued_requests " << serverStats.queuedRequests.load() << "\n"
+            << "accepted_connections " << serverStats.acceptedConnections.load() << "\n"
+            << "rejected_connections " << serverStats.rejectedConnections.load() << "\n"
+            << "shed_requests " << serverStats.shedRequests.load() << "\n"
+            << "expired_requests " << serverStats.expiredRequests.load() << "\n";
+        return httpResponse("200 OK", "text/plain", body, keepAlive, "Cache-Control: no-store\r\n");
+    }
+
+    // Expose the stage latencies and counters to a Prometheus scraper.
+    if (request.method == "GET" && request.path() == "/metrics") {
+        return httpResponse("200 OK", "text/plain; version=0.0.4", metricsExposition(), keepAlive,
+                            "Cache-Control: no-store\r\n");
+    }
+
+    // Handle POST requests: process form data and return search results.
+    if (request.method == "POST" && isRoot) {
+        // Split the form data in the request body into fields.
+        std::unordered_map<std::string, std::string> params;
+        std::string_view body = request.body;
+        while (!body.empty()) {
+            std::string_view pair = body.substr(0, body.find('&'));
+            body.remove_prefix(std::min(body.size(), pair.size() + 1));
+            size_t eqPos = pair.find('=');
+            params[std::string(pair.substr(0, eqPos))] =
+                    eqPos == std::string_view::npos ? std::string() : std::string(pair.substr(eqPos + 1));
+        }
+
+        // Search the index; the page is rendered while it is sent if the client takes chunked responses.
+        auto results = std::make_unique<ResultsPage>(snapshot, std::move(params));
+        if (stream && request.version == "HTTP/1.1") {
+            results->chunked = true;
+            *stream = std::move(results);
+            return httpChunkedHead("200 OK", "text/html", keepAlive);
+        }
+        return httpResponse("200 OK", "text/html", results->renderAll(), keepAlive);
+    }
+
+    // A binary frame carries the page in its first eight bytes and the keywords after them.
+    if (request.binary) {
+        size_t offset = BinaryProtocol::readU32(request.body.data());
+        size_t limit = pageLimit(BinaryProtocol::readU32(request.body.data() + 4));
+        std::string_view text = request.body.substr(BinaryProtocol::MIN_REQUEST_PAYLOAD);
+        std::string buffer;
+        std::vector<std::string> keywords;
+        for (std::string_view token = InvertedIndex::nextToken(text); !token.empty();
+             token = InvertedIndex::nextToken(text)) {
+            std::string_view keyword = InvertedIndex::normalizeWord(token, buffer);
+            if (!keyword.empty()) {
+                keywords.emplace_back(keyword);
+            }
+        }
+        return searchFrame(snapshot->movies, invertedIndex.searchByKeywords(keywords), offset, limit);
+    }
+
+    if (request.method == "SEARCH") {  // Check if the request is a "SEARCH" command.
+        std::string_view text = request.target; // The keyword part after "SEARCH".
+        std::string buffer;
+        std::vector<std::string> keywordsVec;
+        size_t offset = 0, limit = RESULTS_PER_PAGE;
+        bool ranked = false;
+
+        // Process the keywords: clean, convert to lowercase, and store them.
+        for (std::string_view token = InvertedIndex::nextToken(text); !token.empty();
+             token = InvertedIndex::nextToken(text)) {
+            // "offset=N" and "limit=N" select the page of results.
+            if (token.starts_with("offset=")) {
+                offset = parseCount(token.substr(7), offset);
+                continue;
+            }
+            if (token.starts_with("limit=")) {
+                limit = pageLimit(parseCount(token.substr(6), limit));
+                continue;
+            }
+            // "sort=relevance" lists the best BM25 matches first.
+            if (token == "sort=relevance") {
+                ranked = true;
+                continue;
+            }
+            std::string_view keyword = InvertedIndex::normalizeWord(token, buffer);
+            if (!keyword.empty()) {
+                keywordsVec.emplace_back(keyword); // Add the cleaned keyword to the vector.
+            }
+        }
+
+        // Perform a keyword search using the inverted index; the listing ends when the connection closes.
+        std::vector<int> results = invertedIndex.searchByKeywords(keywordsVec);
+        if (ranked) {
+            // Rank up to the end of the page; the other matches follow unranked, so the total stays right.
+            size_t last = std::min(offset, results.size());
+            last += std::min(limit, results.size() - last);
+            std::vector<int> ranking;
+            invertedIndex.rankByRelevance(keywordsVec, results, last, ranking);
+            std::vector<int> listed(ranking);
+            std::sort(listed.begin(), listed.end());
+            std::set_difference(results.begin(), results.end(), listed.begin(), listed.end(),
+                                std::back_inserter(ranking));
+            results.swap(ranking);
+        }
+        auto listing = std::make_unique<SearchListing>(snapshot, std::move(results), offset, limit);
+        if (stream) {
+            *stream = std::move(listing);
+            return std::string();
+        }
+        return listing->renderAll();
+    }
+
+    if (request.method == "GET" || request.method == "POST") {
+        return httpResponse("404 Not Found", "text/plain", "Not Found\n", keepAlive);
+    }
+    return httpResponse("405 Method Not Allowed", "text/plain", "Method Not Allowed\n", keepAlive);
+}
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/epoll.h>
+#include <fcntl.h>
+#endif
+
+/**
+ * @brief Admission limits of the network front end.
+ */
+struct AdmissionLimits {
+    size_t maxQueuedRequests = MAX_QUEUED_REQUESTS; ///< Connections that may wait for a worker at once.
+    std::chrono::milliseconds queueDeadline{QUEUE_DEADLINE_MS}; ///< Longest wait for a worker.
+    size_t maxConnectionsPerClient = MAX_CONNECTIONS_PER_CLIENT; ///< Open connections per client address.
+};
+
+/**
+ * @brief Event-driven network front end of the server.
+ *
+ * Client sockets are multiplexed by a small number of I/O threads instead of occupying a
+ * worker each: an I/O completion port drives overlapped `WSARecv`/`WSASend` on Windows, and
+ * epoll drives non-blocking sockets on Linux. Every connection is a small state machine that
+ * reads until a request is complete, hands it to the `ThreadPool` for processing and writes
+ * the response back, so a slow client never blocks a thread.
+ *
+ * HTTP/1.1 connections are persistent: pipelined requests are answered in order on the same
+ * socket, and connections that stay idle longer than the timeout are closed.
+ *
+ * Under overload the server sheds work instead of queueing it: a client address may only hold
+ * a limited number of connections, and requests are answered with a cheap 503 when too many
+ * are already waiting for a worker or when one has waited past the queue deadline.
+ */
+class EventServer {
+    /**
+     * @brief Per-connection state.
+     *
+     * A connection is owned by exactly one thread at a time: the I/O thread that got its
+     * event, or the worker processing its requests. Nothing else touches it until the next
+     * operation is armed, so no locking is needed.
+     */
+    struct Connection {
+#ifdef _WIN32
+        OVERLAPPED overlapped{}; ///< Overlapped state of the pending receive or send.
+        WSABUF wsaBuffer{}; ///< Buffer descriptor of the pending operation.
+        char readBuffer[BUFFER_SIZE]; ///< Target of overlapped receives.
+#endif
+        SOCKET socket; ///< The client socket.
+        uint32_t client = 0; ///< IPv4 address of the client, for the per-client limit.
+        std::chrono::steady_clock::time_point queuedAt; ///< When the requests were handed to the pool.
+        std::chrono::steady_clock::time_point writeStart; ///< When sending the current response started.
+        std::string input; ///< Receive buffer; reused for every request on the connection.
+        RequestParser parser; ///< Parser state of the next request in `input`.
+        std::string output; ///< Response bytes to be sent.
+        std::unique_ptr<ResponseBody> stream; ///< Rest of the current response, rendered while it is sent.
+        size_t sent = 0; ///< Number of response bytes already sent.
+        bool writing = false; ///< Whether the connection is sending a response.
+        bool keepAlive = true; ///< Whether the connection stays open after the current response.
+        bool peerClosed = false; ///< Whether the client has finished sending.
+    };
+
+    SOCKET listenSocket; ///< The listening server socket.
+    ThreadPool &pool; ///< Workers that process complete requests.
+    AdmissionLimits limits; ///< When connections are refused and requests are shed.
+    std::mutex clientMutex; ///< Guards `clientConnections`.
+    std::unordered_map<uint32_t, size_t> clientConnections; ///< Open connections per client address.
+    size_t numIoThreads; ///< Number of threads waiting for I/O events.
+    std::chrono::seconds idleTimeout; ///< How long a connection may wait for its next request or for send space.
+    std::mutex idleMutex; ///< Guards `idleConnections`.
+    std::unordered_map<Connection *, std::chrono::steady_clock::time_point> idleConnections; ///< Connections waiting for their client, and their deadlines.
+#ifdef _WIN32
+    HANDLE completionPort; ///< The I/O completion port all client sockets are bound to.
+#else
+    int epollFd; ///< The epoll instance watching the listening and client sockets.
+#endif
 
-        // Send the response back to the client.
-        send(clientSocket, response.str().c_str(), response.str().length(), 0);
+public:
+    /**
+     * @brief Creates the event loop for a bound and listening socket.
+     *
+     * @param listenSocket The socket to accept clients from.
+     * @param pool The pool that processes complete requests.
+     * @param numIoThreads The number of I/O threads.
+     * @param idleTimeout How long a connection may wait for its next request before it is closed.
+     * @param limits When connections are refused and requests are shed.
+     */
+    EventServer(SOCKET listenSocket, ThreadPool &pool, size_t numIoThreads, std::chrono::seconds idleTimeout,
+                AdmissionLimits limits = AdmissionLimits())
+            : listenSocket(listenSocket), pool(pool), limits(limits), numIoThreads(std::max<size_t>(1, numIoThreads)),
+              idleTimeout(idleTimeout) {
+#ifdef _WIN32
+        completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+#else
+        epollFd = epoll_create1(0);
+        fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN; // Level-triggered: whichever I/O thread wakes up accepts.
+        event.data.ptr = nullptr; // A null pointer marks the listening socket.
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &event);
+#endif
+    }
+
+    /**
+     * @brief Runs the I/O threads; does not return while the server is running.
+     */
+    void run() {
+        std::vector<std::thread> ioThreads;
+        for (size_t i = 0; i < numIoThreads; ++i) {
+            ioThreads.emplace_back([this]() { eventLoop(); });
+        }
+        ioThreads.emplace_back([this]() { // Enforces the idle timeout.
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                closeIdleConnections();
+            }
+        });
+#ifdef _WIN32
+        acceptLoop(); // Accepting is the only blocking call and has this thread to itself.
+#endif
+        for (std::thread &thread: ioThreads) {
+            thread.join();
+        }
+    }
+
+private:
+    /**
+     * @brief Handles newly received bytes: dispatches complete requests or reads on.
+     */
+    void onInput(Connection *connection) {
+        HttpRequest request;
+        std::string_view pending = connection->input;
+        RequestParser::Status status = RequestParser::Incomplete;
+        if (!pending.empty()) {
+            Metrics::Timer timer(Metrics::Parse);
+            status = connection->parser.parse(pending, request, connection->peerClosed);
+        }
+        if (status != RequestParser::Incomplete) {
+            markBusy(connection);
+            if (static_cast<size_t>(serverStats.queuedRequests.load()) >= limits.maxQueuedRequests) {
+                ++serverStats.shedRequests;
+                rejectBusy(connection);
+                return;
+            }
+            ++serverStats.queuedRequests;
+            connection->queuedAt = std::chrono::steady_clock::now();
+            pool.enqueue([this, connection]() { processRequests(connection); });
+        } else if (connection->peerClosed) {
+            closeConnection(connection);
+        } else {
+            markIdle(connection);
+            startRead(connection);
+        }
+    }
+
+    /**
+     * @brief Answers all complete requests received so far; runs on a worker thread.
+     *
+     * Pipelined requests are processed in order and their responses are sent in one write.
+     * A streamed response ends the batch, so it is never followed by another in the buffer.
+     */
+    void processRequests(Connection *connection) {
+        --serverStats.queuedRequests;
+        std::chrono::steady_clock::duration waited = std::chrono::steady_clock::now() - connection->queuedAt;
+        Metrics::record(Metrics::Queue, waited);
+        if (waited > limits.queueDeadline) {
+            ++serverStats.expiredRequests;
+            rejectBusy(connection);
+            return;
+        }
+        connection->output.clear();
+        connection->sent = 0;
+        size_t consumed = 0; // Bytes of the buffer taken by the requests answered so far.
+        while (connection->keepAlive && consumed < connection->input.size()) {
+            HttpRequest request;
+            std::string_view pending = std::string_view(connection->input).substr(consumed);
+            RequestParser::Status status;
+            {
+                Metrics::Timer timer(Metrics::Parse);
+                status = connection->parser.parse(pending, request, connection->peerClosed);
+            }
+            if (status == RequestParser::Incomplete) break;
+            if (status == RequestParser::Invalid) {
+                connection->keepAlive = false;
+                // A malformed binary frame cannot be answered in its own protocol; the connection just closes.
+                if (!connection->parser.isBinary()) {
+                    connection->output += httpResponse("400 Bad Request", "text/plain", "Bad Request\n", false);
+                }
+                break;
+            }
+            connection->keepAlive = request.keepAlive && !connection->peerClosed;
+            connection->output += handleRequest(request, connection->keepAlive, &connection->stream);
+            Metrics::add(Metrics::Requests);
+            consumed += connection->parser.size();
+            connection->parser.reset();
+            if (connection->stream) break; // Later requests are answered once the stream has been sent.
+        }
+
+        // Drop the answered requests; the buffer keeps its capacity for the next ones.
+        connection->input.erase(0, consumed);
+
+        connection->writing = true;
+        connection->writeStart = std::chrono::steady_clock::now();
+        if (connection->output.empty() && !connection->stream) {
+            closeConnection(connection);
+        } else {
+            startWrite(connection);
+        }
+    }
+
+    /**
+     * @brief The response sent when a request or connection is shed.
+     */
+    static const std::string &busyResponse() {
+        static const std::string response = httpResponse("503 Service Unavailable", "text/plain",
+                                                         "Service Unavailable\n", false, "Retry-After: 1\r\n");
+        return response;
+    }
+
+    /**
+     * @brief Answers a connection with 503 and closes it, without processing its requests.
+     */
+    void rejectBusy(Connection *connection) {
+        connection->input.clear();
+        connection->output = busyResponse();
+        connection->sent = 0;
+        connection->keepAlive = false;
+        connection->writing = true;
+        connection->writeStart = std::chrono::steady_clock::now();
+        startWrite(connection);
+    }
+
+    /**
+     * @brief Counts a new connection against its client's limit.
+     * @return False if the client already holds the maximum number of connections.
+     */
+    bool admitClient(uint32_t client) {
+        std::lock_guard<std::mutex> lock(clientMutex);
+        size_t &count = clientConnections[client];
+        if (count >= limits.maxConnectionsPerClient) return false;
+        ++count;
+        return true;
+    }
+
+    /**
+     * @brief Creates the state of an accepted socket, or refuses it with 503 if its client is over the limit.
+     * @return The new connection, or nullptr if the socket was refused and closed.
+     */
+    Connection *openConnection(SOCKET clientSocket, const sockaddr_in &address) {
+        uint32_t client = address.sin_addr.s_addr;
+        if (!admitClient(client)) {
+            ++serverStats.rejectedConnections;
+            // Best effort: the socket is new, so the short response fits its send buffer.
+            send(clientSocket, busyResponse().data(), static_cast<int>(busyResponse().size()), 0);
+            closesocket(clientSocket);
+            return nullptr;
+        }
+        ++serverStats.acceptedConnections;
+        ++serverStats.openConnections;
+        // Responses are written in large pieces already; waiting for ACKs between the pieces of a
+        // streamed response would only add the client's delayed-ACK time to every request.
+        int noDelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+        Connection *connection = new Connection();
+        connection->socket = clientSocket;
+        connection->client = client;
+        return connection;
+    }
+
+    /**
+     * @brief Renders the next piece of a streamed response into the emptied output buffer.
+     *
+     * Chunked pieces get a fixed-width size line that is filled in once the piece is known,
+     * so the body is rendered in place without another copy.
+     *
+     * @return False if nothing of the current response is left to send.
+     */
+    bool renderNext(Connection *connection) {
+        if (!connection->stream) return false;
+        std::string &output = connection->output;
+        ResponseBody &body = *connection->stream;
+        output.clear();
+        connection->sent = 0;
+        if (!body.chunked) {
+            if (!body.next(output, STREAM_CHUNK_SIZE)) connection->stream.reset();
+            return true;
+        }
+
+        const size_t sizeLine = 10; // Eight hex digits and CRLF.
+        output.assign(sizeLine, '\n');
+        bool more = body.next(output, sizeLine + STREAM_CHUNK_SIZE);
+        size_t length = output.size() - sizeLine;
+        if (length == 0) {
+            output.clear();
+        } else {
+            for (size_t i = 0; i < 8; ++i) {
+                output[7 - i] = "0123456789abcdef"[(length >> (4 * i)) & 15];
+            }
+            output[8] = '\r';
+            output += "\r\n";
+        }
+        if (!more) {
+            output += "0\r\n\r\n"; // The last chunk.
+            connection->stream.reset();
+        }
+        return true;
     }
 
-    // Handle POST requests: process form data and return search results.
-    if (request.find("POST") != std::string::npos) {
-        // Extract the request body containing form data.
-        std::string body = request.substr(request.find("\r\n\r\n") + 4);
-        std::unordered_map<std::string, std::string> params;
-        std::istringstream ss(body);
-        std::string pair;
-        while (std::getline(ss, pair, '&')) {
-            size_t eqPos = pair.find('=');
-            params[pair.substr(0, eqPos)] = pair.substr(eqPos + 1);
+    /**
+     * @brief Continues after a response has been written completely.
+     */
+    void onResponseSent(Connection *connection) {
+        Metrics::record(Metrics::Send, std::chrono::steady_clock::now() - connection->writeStart);
+        markBusy(connection); // The next request gets a fresh idle timeout.
+        if (!connection->keepAlive) {
+            closeConnection(connection);
+            return;
         }
+        connection->writing = false;
+        connection->output.clear();
+        connection->sent = 0;
+        onInput(connection); // Answer requests that were pipelined meanwhile, or wait for the next one.
+    }
 
-        // Search logic based on form parameters.
-        std::unordered_set<int> results;
-        if (!params["genre"].empty()) {
-            std::string genreInput = params["genre"];
-            std::replace(genreInput.begin(), genreInput.end(), '+', ' '); // Заменяем '+' на пробел
+    /**
+     * @brief Starts the idle timeout of a connection that waits for request data.
+     *
+     * A running timeout is kept: bytes that do not complete a request do not extend it, so a
+     * client that trickles in a request (slowloris) is still closed once the timeout expires.
+     */
+    void markIdle(Connection *connection) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleConnections.try_emplace(connection, std::chrono::steady_clock::now() + idleTimeout);
+    }
 
-            std::istringstream genreStream(genreInput);
-            std::string word;
-            std::unordered_set<int> genreResults;
+    /**
+     * @brief Starts or extends the timeout of a connection that waits for its client to read.
+     *
+     * A running timeout restarts only if part of the response was sent since the last wait, so a
+     * slow reader keeps its connection while a client that stops reading is closed.
+     *
+     * @param progressed Whether response bytes were sent since the connection last waited.
+     */
+    void markSending(Connection *connection, bool progressed) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        auto deadline = std::chrono::steady_clock::now() + idleTimeout;
+        if (progressed) {
+            idleConnections[connection] = deadline;
+        } else {
+            idleConnections.try_emplace(connection, deadline);
+        }
+    }
 
-            while (genreStream >> word) { // Разбиваем на отдельные слова
-                std::unordered_set<int> wordResults = invertedIndex.searchByCategory("genre", word);
-                if (genreResults.empty()) {
-                    genreResults = wordResults;
-                } else {
-                    genreResults = invertedIndex.intersectResults(genreResults, wordResults);
-                }
-            }
+    /**
+     * @brief Stops the idle timeout of a connection.
+     */
+    void markBusy(Connection *connection) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleConnections.erase(connection);
+    }
 
-            if (results.empty()) {
-                results = genreResults;
-            } else {
-                results = invertedIndex.intersectResults(results, genreResults);
-            }
-        }
-        if (!params["year"].empty()) {
-            std::unordered_set<int> yearResults = invertedIndex.searchByCategory("year", params["year"]);
-            if (results.empty()) {
-                results = yearResults;
+    /**
+     * @brief Aborts the pending receive or send of every connection whose timeout has expired.
+     *
+     * The connection itself is closed by the I/O thread that gets the aborted receive, so the
+     * sweeper never frees state another thread may be using.
+     */
+    void closeIdleConnections() {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(idleMutex);
+        for (auto it = idleConnections.begin(); it != idleConnections.end();) {
+            if (it->second <= now) {
+#ifdef _WIN32
+                CancelIoEx(reinterpret_cast<HANDLE>(it->first->socket), &it->first->overlapped);
+#else
+                shutdown(it->first->socket, SHUT_RDWR);
+#endif
+                it = idleConnections.erase(it);
             } else {
-                results = invertedIndex.intersectResults(results, yearResults);
+                ++it;
             }
         }
+    }
 
-        if (!params["language"].empty()) {
-            std::unordered_set<int> languageResults = invertedIndex.searchByCategory("language", params["language"]);
-            if (results.empty()) {
-                results = languageResults;
-            } else {
-                results = invertedIndex.intersectResults(results, languageResults);
-            }
+    /**
+     * @brief Closes a client socket and releases its state.
+     */
+    void closeConnection(Connection *connection) {
+        markBusy(connection);
+        {
+            std::lock_guard<std::mutex> lock(clientMutex);
+            auto it = clientConnections.find(connection->client);
+            if (it != clientConnections.end() && --it->second == 0) clientConnections.erase(it);
         }
-        if (!params["keywords"].empty()) {
-            std::istringstream kwStream(params["keywords"]);
-            std::string keyword;
-            std::vector<std::string> keywords;
+        --serverStats.openConnections;
+        closesocket(connection->socket);
+        delete connection;
+    }
 
-            // Process keywords: split and clean
-            while (std::getline(kwStream, keyword, '+')) {
-                keyword = InvertedIndex::toLower(InvertedIndex::cleanWord(keyword));
-                if (!keyword.empty()) {
-                    keywords.push_back(keyword);
-                }
+#ifdef _WIN32
+    /**
+     * @brief Accepts clients and binds them to the completion port.
+     */
+    void acceptLoop() {
+        while (true) {
+            sockaddr_in address{};
+            int addressLength = sizeof(address);
+            SOCKET clientSocket = accept(listenSocket, reinterpret_cast<sockaddr *>(&address), &addressLength);
+            if (clientSocket == INVALID_SOCKET) {
+                std::cerr << "Error: Unable to accept connection!" << std::endl;
+                continue;
             }
+            Connection *connection = openConnection(clientSocket, address);
+            if (!connection) continue;
+            CreateIoCompletionPort(reinterpret_cast<HANDLE>(clientSocket), completionPort,
+                                   reinterpret_cast<ULONG_PTR>(connection), 0);
+            markIdle(connection);
+            startRead(connection);
+        }
+    }
 
-            // Search for each keyword in the index
-            for (const auto &word: keywords) {
-                std::unordered_set<int> wordResults;
-
-                for (const std::string &category: {"title_", "overview_", "genre_", "language_", "year_", "rating_"}) {
-                    std::string fullKey = category + word;
-
-                    // Iterate over all shards
-                    for (size_t shardIndex = 0; shardIndex < invertedIndex.getIndexData().size(); ++shardIndex) {
-                        const auto &shard = invertedIndex.getIndexData()[shardIndex];
-                        auto it = shard.find(fullKey);
-                        if (it != shard.end()) {
-                            wordResults.insert(it->second.begin(), it->second.end());
-                        }
-                    }
-                }
+    /**
+     * @brief Dequeues completions and advances the connections they belong to.
+     */
+    void eventLoop() {
+        while (true) {
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED *overlapped = nullptr;
+            BOOL ok = GetQueuedCompletionStatus(completionPort, &bytes, &key, &overlapped, INFINITE);
+            if (overlapped == nullptr) return; // The port itself failed.
 
-                // Combine results with intersection
-                if (results.empty()) {
-                    results = wordResults;
-                } else {
-                    results = invertedIndex.intersectResults(results, wordResults);
-                }
+            Connection *connection = reinterpret_cast<Connection *>(key);
+            if (!ok) {
+                closeConnection(connection); // The receive or send failed or was cancelled.
+            } else if (connection->writing) {
+                connection->sent += bytes;
+                Metrics::add(Metrics::BytesSent, bytes);
+                startWrite(connection);
+            } else {
+                connection->input.append(connection->readBuffer, bytes);
+                connection->peerClosed = bytes == 0;
+                onInput(connection);
             }
         }
+    }
 
-        std::vector<int> sortedResults(results.begin(), results.end());
-        // Sort results if specified.
-        if (params["sort"] == "rating_asc") {
-            std::sort(sortedResults.begin(), sortedResults.end(), [&](int a, int b) {
-                return movies[a].rating < movies[b].rating;
-            });
-        } else if (params["sort"] == "rating_desc") {
-            std::sort(sortedResults.begin(), sortedResults.end(), [&](int a, int b) {
-                return movies[a].rating > movies[b].rating;
-            });
+    /**
+     * @brief Posts an overlapped receive for more request data.
+     */
+    void startRead(Connection *connection) {
+        ZeroMemory(&connection->overlapped, sizeof(connection->overlapped));
+        connection->wsaBuffer.buf = connection->readBuffer;
+        connection->wsaBuffer.len = BUFFER_SIZE;
+        DWORD flags = 0;
+        if (WSARecv(connection->socket, &connection->wsaBuffer, 1, nullptr, &flags, &connection->overlapped,
+                    nullptr) == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+            closeConnection(connection);
         }
+    }
 
-
-        // Build the HTML response with search results.
-        std::ostringstream response;
-        response << "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n";
-        response << R"(
-<!DOCTYPE html>
-<html lang="en">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Movie Search Results</title>
-    <style>
-        @import url('https://fonts.googleapis.com/css2?family=Roboto:wght@400;500;700&display=swap');
-
-        body {
-            font-family: 'Roboto', sans-serif;
-            background-color: #f5f5f5;
-            margin: 0;
-            padding: 0;
-        }
-        .container {
-            max-width: 1000px;
-            margin: 20px auto;
-            background: #fff;
-            padding: 20px;
-            border-radius: 8px;
-            box-shadow: 0 4px 6px rgba(0, 0, 0, 0.1);
-        }
-        .header {
-            display: flex;
-            justify-content: space-between;
-            align-items: center;
-            margin-bottom: 20px;
-        }
-        .header h1 {
-            margin: 0;
-            font-size: 24px;
-            color: #333;
-        }
-        .sort-buttons {
-            display: flex;
-            align-items: center;
-            gap: 10px;
-        }
-        .sort-buttons .sort-label {
-            font-size: 16px;
-            font-weight: 500;
-            color: #333;
-        }
-        .arrow-button {
-            background-color: #007bff;
-            color: #fff;
-            border: none;
-            border-radius: 4px;
-            padding: 5px 10px;
-            font-size: 16px;
-            cursor: pointer;
-            line-height: 1;
-        }
-        .arrow-button:hover {
-            background-color: #0056b3;
-        }
-        .movie-list {
-            list-style: none;
-            padding: 0;
-        }
-        .movie-item {
-            display: flex;
-            align-items: flex-start;
-            padding: 15px;
-            border-bottom: 1px solid #ddd;
-        }
-        .movie-item:last-child {
-            border-bottom: none;
-        }
-        .poster {
-            flex: 0 0 120px;
-            margin-right: 15px;
-        }
-        .poster img {
-            width: 120px;
-            height: auto;
-            border-radius: 4px;
-        }
-        .details {
-            flex: 1;
-        }
-        .title {
-            font-size: 18px;
-            font-weight: bold;
-            margin: 0;
-            color: #007bff;
-        }
-        .title:hover {
-            text-decoration: underline;
-            cursor: pointer;
-        }
-        .info {
-            font-size: 14px;
-            color: #555;
-            margin-top: 5px;
-        }
-        .rating {
-            color: #f39c12;
-            font-weight: bold;
-        }
-        .genres {
-            font-size: 14px;
-            color: #777;
-            margin-top: 5px;
+    /**
+     * @brief Posts an overlapped send of the unsent response, or moves on when it is complete.
+     */
+    void startWrite(Connection *connection) {
+        while (connection->sent >= connection->output.size()) {
+            if (!renderNext(connection)) {
+                onResponseSent(connection);
+                return;
+            }
         }
-        .overview {
-            margin-top: 10px;
-            font-size: 14px;
-            color: #333;
+        markSending(connection, true); // Every send is posted after the previous one completed.
+        ZeroMemory(&connection->overlapped, sizeof(connection->overlapped));
+        connection->wsaBuffer.buf = connection->output.data() + connection->sent;
+        connection->wsaBuffer.len = static_cast<ULONG>(connection->output.size() - connection->sent);
+        if (WSASend(connection->socket, &connection->wsaBuffer, 1, nullptr, 0, &connection->overlapped,
+                    nullptr) == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+            closeConnection(connection);
         }
-    </style>
-</head>
-<body>
-    <div class="container">
-        <div class="header">
-            <h1>Movie Search Results</h1>
-            <div class="sort-buttons">
-<span class="sort-label">Sort by Rating</span>
-    <form method="POST" style="display: inline;">
-        <input type="hidden" name="genre" value=")" << params["genre"] << R"(">
-        <input type="hidden" name="year" value=")" << params["year"] << R"(">
-        <input type="hidden" name="language" value=")" << params["language"] << R"(">
-        <input type="hidden" name="keywords" value=")" << params["keywords"] << R"(">
-        <input type="hidden" name="sort" value="rating_asc">
-        <button type="submit" class="arrow-button">&#9650;</button>
-    </form>
-    <form method="POST" style="display: inline;">
-        <input type="hidden" name="genre" value=")" << params["genre"] << R"(">
-        <input type="hidden" name="year" value=")" << params["year"] << R"(">
-        <input type="hidden" name="language" value=")" << params["language"] << R"(">
-        <input type="hidden" name="keywords" value=")" << params["keywords"] << R"(">
-        <input type="hidden" name="sort" value="rating_desc">
-        <button type="submit" class="arrow-button">&#9660;</button>
-    </form>
-            </div>
-        </div>
-        <ul class="movie-list">
-)";
-        if (results.empty()) {
-            response << "No movies match your search criteria.\n";
-        } else {
-            for (const auto &id: sortedResults) {
-                response << R"(<li class="movie-item">)"
-                         << "<div class='poster'><img src='" << movies[id].posterUrl << "' alt='Movie Poster'></div>"
-                         << "<div class='details'>"
-                         << "<p class='title'>" << movies[id].title << "</p>"
-                         << "<p class='info'>" << movies[id].year << " | <span class='rating'>" << movies[id].rating
-                         << "</span> | "
-                         << "<span class='language'>" << movies[id].language << "</span></p>"
-                         << "<p class='genres'>Genres: ";
-                for (const auto &genre: movies[id].genres) {
-                    response << genre << ", ";
+    }
+#else
+    /**
+     * @brief Waits for readiness events and advances the connections they belong to.
+     */
+    void eventLoop() {
+        epoll_event events[64];
+        while (true) {
+            int count = epoll_wait(epollFd, events, 64, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            for (int i = 0; i < count; ++i) {
+                Connection *connection = static_cast<Connection *>(events[i].data.ptr);
+                if (connection == nullptr) {
+                    acceptConnections();
+                } else if (events[i].events & EPOLLERR) {
+                    closeConnection(connection);
+                } else if (connection->writing) {
+                    startWrite(connection);
+                } else {
+                    readAvailable(connection);
                 }
-                response.seekp(-2, std::ios_base::cur); // Убираем последнюю запятую
-                response << "</p>"
-                         << "<p class='overview'>" << movies[id].overview << "</p>"
-                         << "</div></li>";
             }
         }
-
-        response << R"(
-        </ul>
-    </div>
-</body>
-</html>
-)";
-        // Send the response.
-        send(clientSocket, response.str().c_str(), response.str().length(), 0);
     }
 
-    if (request.find("SEARCH") == 0) {  // Check if the request is a "SEARCH" command.
-        std::string keywords = request.substr(7); // Extract the keyword part after "SEARCH".
-        std::istringstream kwStream(keywords);
-        std::string keyword;
-        std::vector<std::string> keywordsVec;
-
-        // Process the keywords: clean, convert to lowercase, and store them.
-        while (kwStream >> keyword) {
-            keyword = InvertedIndex::toLower(InvertedIndex::cleanWord(keyword));
-            if (!keyword.empty()) {
-                keywordsVec.push_back(keyword); // Add the cleaned keyword to the vector.
-            }
-        }
-
-        // Perform a keyword search using the inverted index.
-        std::unordered_set<int> results = invertedIndex.searchByKeywords(keywordsVec);
-
-        // Build the response.
-        std::ostringstream response;
-        if (results.empty()) {
-            response << "No movies found\n"; // Inform the client if no matches are found.
-        } else {
-            // Iterate through the results and include movie details in the response.
-            for (int id: results) {
-                response << "Title: " << movies[id].title << "\n"
-                         << "Year: " << movies[id].year << "\n"
-                         << "Rating: " << movies[id].rating << "\n"
-                         << "Language: " << movies[id].language << "\n"
-                         << "Genres: ";
-                for (const auto &genre: movies[id].genres) {
-                    response << genre << " "; // Append each genre to the response.
+    /**
+     * @brief Accepts all pending clients and starts watching them.
+     */
+    void acceptConnections() {
+        while (true) {
+            sockaddr_in address{};
+            socklen_t addressLength = sizeof(address);
+            SOCKET clientSocket = accept4(listenSocket, reinterpret_cast<sockaddr *>(&address), &addressLength,
+                                          SOCK_NONBLOCK);
+            if (clientSocket == INVALID_SOCKET) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "Error: Unable to accept connection!" << std::endl;
                 }
-                response << "\nOverview: " << movies[id].overview << "\n\n";
+                return;
+            }
+            Connection *connection = openConnection(clientSocket, address);
+            if (!connection) continue;
+            markIdle(connection);
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            event.data.ptr = connection;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) != 0) {
+                closeConnection(connection);
             }
         }
-        // Send the response back to the client.
-        send(clientSocket, response.str().c_str(), response.str().length(), 0);
-        // Close the client socket to end the connection.
-        closesocket(clientSocket); // Exit after handling the "SEARCH" command.
-        return;
     }
 
-
-    closesocket(clientSocket);
-}
-
-/**
- * @brief A thread pool for managing client connections in a multithreaded server.
- *
- * The `ThreadPool` class creates a fixed number of worker threads to handle incoming
- * tasks (e.g., client connections). Tasks are added to a thread-safe queue and processed
- * by available threads. The pool ensures efficient resource utilization and scalability.
- */
-class ThreadPool {
-    std::vector<std::thread> workers; ///< Vector of worker threads.
-    std::queue<SOCKET> tasks; ///< Queue of tasks (client sockets) to be processed.
-    std::mutex queueMutex; ///< Mutex for synchronizing access to the task queue.
-    std::condition_variable cv;  ///< Condition variable to notify threads of new tasks.
-    bool stop; ///< Flag to signal threads to stop processing.
-
-public:
     /**
-     * @brief Constructs the thread pool and initializes worker threads.
+     * @brief Re-arms the one-shot registration of a connection.
      *
-     * @param numThreads The number of worker threads to create.
+     * @param events `EPOLLIN` to wait for more request data, `EPOLLOUT` to wait for send space.
      */
-    ThreadPool(size_t numThreads) : stop(false) {
-        for (size_t i = 0; i < numThreads; ++i) {
-            workers.emplace_back([this]() {
-                while (true) {
-                    SOCKET clientSocket;
-                    {
-                        // Lock the task queue and wait for a task or stop signal.
-                        std::unique_lock<std::mutex> lock(queueMutex);
-                        cv.wait(lock, [this]() { return stop || !tasks.empty(); });
-                        if (stop && tasks.empty()) return; // Exit the thread if stopping.
-                        clientSocket = tasks.front(); // Retrieve the next task.
-                        tasks.pop(); // Remove the task from the queue.
-                    }
-                    handleClient(clientSocket); // Process the client request.
-                }
-            });
+    void watch(Connection *connection, uint32_t events) {
+        epoll_event event{};
+        event.events = events | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.ptr = connection;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->socket, &event) != 0) {
+            closeConnection(connection);
         }
     }
+
     /**
-        * @brief Adds a new task (client socket) to the thread pool's queue.
-        *
-        * @param clientSocket The socket representing the client connection.
-        */
-    void enqueue(SOCKET clientSocket) {
-        {
-            std::lock_guard<std::mutex> lock(queueMutex); // Lock the queue for safe access.
-            tasks.push(clientSocket); // Add the client socket to the task queue.
+     * @brief Drains the socket into the request buffer.
+     */
+    void readAvailable(Connection *connection) {
+        char buffer[BUFFER_SIZE];
+        while (true) {
+            ssize_t received = recv(connection->socket, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                connection->input.append(buffer, received);
+            } else if (received == 0) {
+                connection->peerClosed = true;
+                break;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno != EINTR) {
+                closeConnection(connection);
+                return;
+            }
         }
-        cv.notify_one(); // Notify one worker thread about the new task.
+        onInput(connection);
     }
 
     /**
-         * @brief Destroys the thread pool and stops all worker threads.
-         *
-         * This destructor sets the stop flag, notifies all threads, and waits for their
-         * completion before cleaning up.
-         */
-    ~ThreadPool() {
-        {
-            std::lock_guard<std::mutex> lock(queueMutex); // Lock the queue to set the stop flag.
-            stop = true;  // Signal threads to stop processing.
-        }
-        cv.notify_all(); // Wake up all threads to allow them to exit.
-        for (std::thread &worker: workers) {
-            worker.join(); // Wait for each thread to finish.
-        }
+     * @brief Waits for more request data.
+     */
+    void startRead(Connection *connection) {
+        watch(connection, EPOLLIN);
+    }
+
+    /**
+     * @brief Sends as much of the response as the socket takes, or moves on when it is complete.
+     */
+    void startWrite(Connection *connection) {
+        bool progressed = false;
+        do {
+            while (connection->sent < connection->output.size()) {
+                ssize_t written = send(connection->socket, connection->output.data() + connection->sent,
+                                       connection->output.size() - connection->sent, MSG_NOSIGNAL);
+                if (written >= 0) {
+                    connection->sent += written;
+                    progressed |= written > 0;
+                    Metrics::add(Metrics::BytesSent, static_cast<uint64_t>(written));
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    markSending(connection, progressed);
+                    watch(connection, EPOLLOUT);
+                    return;
+                } else if (errno != EINTR) {
+                    closeConnection(connection);
+                    return;
+                }
+            }
+        } while (renderNext(connection));
+        onResponseSent(connection);
     }
+#endif
 };
 
 /**
  * @brief Periodically updates the inverted index by reloading movie data from a file.
  *
- * This function runs a background thread that periodically invokes the `loadMovies` function
- * to refresh the movie data and rebuild the inverted index. It operates at a fixed interval
+ * This function runs a background thread that periodically invokes the `reloadMovies` function
+ * to refresh the movie data when the file has changed. It operates at a fixed interval
  * specified in minutes.
  *
  * @param filePath The path to the movie data file (CSV format).
@@ -928,8 +5693,8 @@ void updateIndexPeriodically(const std::string &filePath, int intervalMinutes) {
     std::thread([filePath, intervalMinutes]() {
         while (true) {
             std::this_thread::sleep_for(std::chrono::minutes(intervalMinutes)); // Wait for the specified interval.
-            // Reload the movie data and rebuild the index with 8 threads.
-            loadMovies(filePath, 8);
+            // Reload the movie data with 8 threads if the file has changed.
+            reloadMovies(filePath, 8);
         }
     }).detach(); // Detach the thread to run independently.
 }
@@ -958,17 +5723,19 @@ void logPerformanceData(const std::string &filePath, size_t numThreads, double e
     }
 }
 
+// Benchmarks include this file with COURSEWORK_NO_SERVER_MAIN defined to reuse the loader and index.
+#ifndef COURSEWORK_NO_SERVER_MAIN
 /**
  * @brief Entry point of the server application.
  *
  * This function initializes the server, loads movie data, starts periodic index updates,
- * and processes incoming client requests using a thread pool.
+ * and serves client requests through the event loop and a thread pool.
  *
  * Key Steps:
  * 1. Load and index movie data in parallel.
  * 2. Log performance metrics.
  * 3. Periodically update the inverted index.
- * 4. Set up and run a multithreaded server to handle client requests.
+ * 4. Set up the server socket and run the event-driven I/O threads.
  *
  * @return 0 on successful execution.
  */
@@ -990,9 +5757,15 @@ int main() {
     updateIndexPeriodically(path, 1);
 
     // Initialize Winsock and create a server socket.
+#ifdef _WIN32
     WSADATA wsaData;
     WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
     SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+#ifndef _WIN32
+    int reuse = 1; // Allow restarting while old connections are in TIME_WAIT.
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
 
     // Configure the server address and bind the socket.
     sockaddr_in serverAddr{};
@@ -1003,24 +5776,20 @@ int main() {
     bind(serverSocket, (sockaddr *) &serverAddr, sizeof(serverAddr));
     listen(serverSocket, SOMAXCONN);
 
-    // Create a thread pool for handling client connections.
-    ThreadPool pool(std::thread::hardware_concurrency());
+    // Process requests on the shared pool, with a few I/O threads for the sockets.
+    EventServer server(serverSocket, sharedPool(), 2, std::chrono::seconds(IDLE_TIMEOUT_SECONDS));
 
     // Start accepting and processing client requests.
     std::cout << "Server is running on port " << PORT << std::endl;
     std::cout << "Open this link in your browser: http://127.0.0.1:" << PORT << std::endl;
 
-    while (true) {
-        SOCKET clientSocket = accept(serverSocket, nullptr, nullptr);
-        if (clientSocket == INVALID_SOCKET) {
-            std::cerr << "Error: Unable to accept connection!" << std::endl;
-            continue;
-        }
-        pool.enqueue(clientSocket); // Delegate the request to the thread pool.
-    }
+    server.run();
 
     // Close the server socket and shutdown Winsock.
     closesocket(serverSocket);
+#ifdef _WIN32
     WSACleanup();
+#endif
     return 0;
-}
\ No newline at end of file
+}
+#endif